@@ -55,6 +55,8 @@ const vector<string> Defaults = {
 /// bench 64 4 5000 current movetime -> search current position with 4 threads for 5 sec
 /// bench 64 1 100000 default nodes -> search default positions for 100K nodes each
 /// bench 16 1 5 default perft -> run a perft 5 on default positions
+/// bench tt 64 1 15 -> compare the TT replacement policies, see bench_tt() in uci.cpp
+/// bench scaling 16 64 15 -> search with 1, 2, 4, 8 and 16 threads, see bench_scaling() in uci.cpp
 
 vector<string> setup_bench(const Position& current, istream& is) {
 
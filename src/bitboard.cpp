@@ -40,8 +40,13 @@ Bitboard PawnAttackSpan[COLOR_NB][SQUARE_NB];
 Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
 Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
 
+#ifdef ROOK_MAGIC
 Magic RookMagics[SQUARE_NB];
 Magic BishopMagics[SQUARE_NB];
+#else
+uint8_t RankAttacks[64][FILE_NB];
+Bitboard FileAttacks[RANK_NB][64];
+#endif
 
 namespace {
 
@@ -51,9 +56,14 @@ namespace {
 
   int MSBTable[256];            // To implement software msb()
   Square BSFTable[SQUARE_NB];   // To implement software bitscan
+
+#ifdef ROOK_MAGIC
   Bitboard RookTable[0x19000];  // To store rook attacks
 
   void init_magics(Bitboard table[], Magic magics[], Square deltas[]);
+#else
+  void init_rank_file(Square deltas[]);
+#endif
 
   // bsf_index() returns the index into BSFTable[] to look up the bitscan. Uses
   // Matt Taylor's folding for 32 bit case, extended to 64 bit by Kim Walisch.
@@ -200,7 +210,11 @@ void Bitboards::init() {
 
   Square RookDeltas[] = { NORTH,  EAST,  SOUTH,  WEST };
 
+#ifdef ROOK_MAGIC
   init_magics(RookTable, RookMagics, RookDeltas);
+#else
+  init_rank_file(RookDeltas);
+#endif
 
   for (Square s1 = SQ_A1; s1 <= SQ_H8; ++s1)
   {
@@ -240,6 +254,8 @@ namespace {
   }
 
 
+#ifdef ROOK_MAGIC
+
   // init_magics() computes all rook and bishop attacks at startup. Magic
   // bitboards are used to look up attacks of sliding pieces. As a reference see
   // chessprogramming.wikispaces.com/Magic+Bitboards. In particular, here we
@@ -319,4 +335,31 @@ namespace {
         }
     }
   }
+
+#else
+
+  // init_rank_file() computes the tables of rook attacks along the first rank
+  // and along the A-file, for all the occupancies of the inner squares.
+
+  void init_rank_file(Square deltas[]) {
+
+    for (int idx = 0; idx < 64; ++idx)
+    {
+        Bitboard rankOcc = Bitboard(idx) << 1, fileOcc = 0;
+
+        for (Rank r = RANK_2; r <= RANK_7; ++r)
+            if (idx & (1 << (r - RANK_2)))
+                fileOcc |= make_square(FILE_A, r);
+
+        assert(((fileOcc * FileGather) >> 58) == Bitboard(idx));
+
+        for (File f = FILE_A; f <= FILE_H; ++f)
+            RankAttacks[idx][f] = uint8_t(sliding_attack(deltas, make_square(f, RANK_1), rankOcc) & Rank1BB);
+
+        for (Rank r = RANK_1; r <= RANK_8; ++r)
+            FileAttacks[r][idx] = sliding_attack(deltas, make_square(FILE_A, r), fileOcc) & FileABB;
+    }
+  }
+
+#endif
 }
@@ -77,6 +77,21 @@ extern Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
 extern Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
 
 
+/// The rook is the only slider of Shatranj. How its attacks are computed is
+/// chosen at build time with rook= in the Makefile:
+///
+/// magic        Fancy magic bitboards, or PEXT with pext=yes, over an 800 KB
+///              table of attacks (default).
+/// kindergarten Rank and file are looked up apart, in tables of 512 bytes and
+///              4 KB, gathering the file occupancy with a multiplication
+///              (ROOK_KINDERGARTEN).
+/// hq           The rank is looked up as above and the file is computed with
+///              Hyperbola Quintessence, a subtraction on the occupancy and on
+///              its byte swap (ROOK_HQ).
+
+#if !defined(ROOK_KINDERGARTEN) && !defined(ROOK_HQ)
+#define ROOK_MAGIC
+
 /// Magic holds all magic bitboards relevant data for a single square
 struct Magic {
   Bitboard  mask;
@@ -102,6 +117,19 @@ struct Magic {
 extern Magic RookMagics[SQUARE_NB];
 extern Magic BishopMagics[SQUARE_NB];
 
+#else
+
+/// RankAttacks[][] are the rook attacks along the first rank, indexed by the
+/// occupancy of files B to G and by the file of the rook. FileAttacks[][] are
+/// the ones along the A-file, indexed by the rank of the rook and the occupancy
+/// of ranks 2 to 7, gathered by a multiplication with FileGather.
+extern uint8_t RankAttacks[64][FILE_NB];
+extern Bitboard FileAttacks[RANK_NB][64];
+
+const Bitboard FileGather = 0x0004081020408000ULL;
+
+#endif
+
 
 /// Overloads of bitwise operators between a Bitboard and a Square for testing
 /// whether a given bit is set in a bitboard, and for setting and clearing bits.
@@ -236,14 +264,57 @@ template<> inline int distance<File>(Square x, Square y) { return distance(file_
 template<> inline int distance<Rank>(Square x, Square y) { return distance(rank_of(x), rank_of(y)); }
 
 
+/// byteswap() reverses the order of the bytes, so the ranks, of a bitboard
+
+inline Bitboard byteswap(Bitboard b) {
+
+#if defined(__GNUC__)
+
+  return __builtin_bswap64(b);
+
+#elif defined(_MSC_VER)
+
+  return _byteswap_uint64(b);
+
+#else
+
+  b = ((b >>  8) & 0x00FF00FF00FF00FFULL) | ((b & 0x00FF00FF00FF00FFULL) <<  8);
+  b = ((b >> 16) & 0x0000FFFF0000FFFFULL) | ((b & 0x0000FFFF0000FFFFULL) << 16);
+  return (b >> 32) | (b << 32);
+
+#endif
+}
+
+
 /// attacks_bb() returns a bitboard representing all the squares attacked by a
-/// piece of type Pt (bishop or rook) placed on 's'.
+/// piece of type Pt (only the rook, see above) placed on 's'.
 
 template<PieceType Pt>
 inline Bitboard attacks_bb(Square s, Bitboard occupied) {
 
+#ifdef ROOK_MAGIC
+
   const Magic& m = RookMagics[s];
   return m.attacks[m.index(occupied)];
+
+#else
+
+  const File f = file_of(s);
+  const Rank r = rank_of(s);
+  Bitboard b = Bitboard(RankAttacks[(occupied >> (8 * r + 1)) & 63][f]) << (8 * r);
+
+#ifdef ROOK_KINDERGARTEN
+
+  return b | FileAttacks[r][(((occupied >> f) & FileABB) * FileGather) >> 58] << f;
+
+#else
+
+  const Bitboard mask = FileBB[f] ^ s;
+  Bitboard o = occupied & mask;
+  return b | (((o - SquareBB[s]) ^ byteswap(byteswap(o) - SquareBB[s ^ 56])) & mask);
+
+#endif
+#endif
 }
 
 inline Bitboard attacks_bb(PieceType pt, Square s, Bitboard occupied) {
@@ -0,0 +1,484 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2017 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _WIN32
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>   // For std::strncpy
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "cluster.h"
+#include "thread.h"
+#include "uci.h"
+
+#ifndef _WIN32
+
+namespace {
+
+  // Worker keeps the connection to a worker process and the latest results of
+  // its search, updated by a reader thread from the "info" and "bestmove" lines.
+  // Closing the connection makes the worker process quit.
+  struct Worker {
+    ~Worker() {
+      shutdown(fd, SHUT_RDWR); // Wakes up the reader thread
+      reader.join();
+      close(fd);
+    }
+
+    std::string address;
+    int fd;
+    std::thread reader;
+    Mutex mutex;
+    ConditionVariable cv;
+    bool active = false;    // Has a share of the root moves in the current search
+    bool searching = false; // Until its "bestmove" is received
+    bool dead = false;      // Connection lost, dropped at the next split
+    int depth = 0;
+    std::string score, pv, bestMove, ponder;
+  };
+
+  std::vector<std::unique_ptr<Worker>> Workers;
+  std::string PositionCmd = "position startpos";
+  bool StopWorkers; // Whether the workers have to be stopped by the master
+
+  // lost() marks a worker whose connection is gone, so that nobody waits for
+  // its best move any longer
+  void lost(Worker& w) {
+
+    std::lock_guard<Mutex> lk(w.mutex);
+    w.dead = true;
+    w.active = w.searching = false;
+    w.cv.notify_all();
+  }
+
+  void send(Worker& w, const std::string& line) {
+
+    std::string s = line + "\n";
+
+    if (write(w.fd, s.c_str(), s.size()) != ssize_t(s.size()))
+    {
+        sync_cout << "info string Lost cluster worker " << w.address << sync_endl;
+        lost(w);
+    }
+  }
+
+  // to_cp() converts a UCI score ("cp x" or "mate y") to centipawns, with the
+  // mate scores beyond any other score
+  int to_cp(const std::string& score) {
+
+    std::istringstream is(score);
+    std::string type;
+    int v = 0;
+
+    is >> type >> v;
+    return type != "mate" ? v : v > 0 ? 100000 - v : -100000 - v;
+  }
+
+  // parse() updates the worker state from a line of its output. Only the "info"
+  // lines with a PV and an exact score are kept.
+  void parse(Worker& w, const std::string& line) {
+
+    std::istringstream is(line);
+    std::string token, score, pv;
+    int depth = 0;
+    bool bound = false;
+
+    is >> token;
+
+    if (token == "info")
+    {
+        while (is >> token)
+            if (token == "depth")
+                is >> depth;
+
+            else if (token == "score")
+            {
+                std::string type, value;
+                is >> type >> value;
+                score = type + " " + value;
+            }
+            else if (token == "lowerbound" || token == "upperbound")
+                bound = true;
+
+            else if (token == "pv")
+            {
+                std::getline(is >> std::ws, pv);
+                break;
+            }
+
+        if (!pv.empty() && !score.empty() && !bound)
+        {
+            std::lock_guard<Mutex> lk(w.mutex);
+            w.depth = depth, w.score = score, w.pv = pv;
+        }
+    }
+    else if (token == "bestmove")
+    {
+        std::lock_guard<Mutex> lk(w.mutex);
+        is >> w.bestMove;
+        if (is >> token && token == "ponder")
+            is >> w.ponder;
+        w.searching = false;
+        w.cv.notify_all();
+    }
+  }
+
+  // read_loop() is run by the reader thread of a worker until the connection is
+  // closed, by either side
+  void read_loop(Worker* w) {
+
+    std::string buf;
+    char chunk[4096];
+    ssize_t n;
+
+    while ((n = read(w->fd, chunk, sizeof(chunk))) > 0)
+    {
+        buf.append(chunk, size_t(n));
+
+        for (size_t eol; (eol = buf.find('\n')) != std::string::npos; buf.erase(0, eol + 1))
+            parse(*w, buf.substr(0, eol));
+    }
+
+    lost(*w);
+  }
+
+  // open_socket() returns a socket connected to the given address or, if
+  // 'listening' is true, listening on it. It returns -1 on failure. Addresses
+  // with a '/' are Unix socket paths, the others TCP "host:port" or "port".
+  // Without a host, only the loopback interface is used: a served engine runs
+  // any command of whoever connects, so listening on the other interfaces has
+  // to be asked for with an explicit host, like "0.0.0.0:port" or "[::]:port".
+  int open_socket(const std::string& address, bool listening) {
+
+    int fd = -1;
+
+    if (address.find('/') != std::string::npos)
+    {
+        sockaddr_un addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, address.c_str(), sizeof(addr.sun_path) - 1);
+
+        if ((fd = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+            return -1;
+
+        if (listening)
+            unlink(addr.sun_path);
+
+        if (listening ? bind(fd, (sockaddr*)&addr, sizeof(addr)) || listen(fd, 1)
+                      : ::connect(fd, (sockaddr*)&addr, sizeof(addr)))
+            close(fd), fd = -1;
+
+        return fd;
+    }
+
+    size_t colon = address.rfind(':');
+    std::string host = colon == std::string::npos ? "" : address.substr(0, colon);
+    std::string port = colon == std::string::npos ? address : address.substr(colon + 1);
+
+    if (host.empty())
+        host = "127.0.0.1";
+
+    else if (host.size() > 2 && host.front() == '[' && host.back() == ']')
+        host = host.substr(1, host.size() - 2);
+
+    addrinfo hints, *res;
+    std::memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res))
+        return -1;
+
+    for (addrinfo* ai = res; ai && fd == -1; ai = ai->ai_next)
+    {
+        if ((fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol)) == -1)
+            continue;
+
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // Short lines, send now
+
+        if (listening ? bind(fd, ai->ai_addr, ai->ai_addrlen) || listen(fd, 1)
+                      : ::connect(fd, ai->ai_addr, ai->ai_addrlen))
+            close(fd), fd = -1;
+    }
+
+    freeaddrinfo(res);
+    return fd;
+  }
+
+} // namespace
+
+
+/// Cluster::connect() is called when the "Cluster Workers" option changes. It
+/// drops the current workers and connects to the ones in the given comma
+/// separated list of addresses.
+
+void Cluster::connect(const std::string& workers) {
+
+  Workers.clear();
+
+  if (workers == "<empty>")
+      return;
+
+  signal(SIGPIPE, SIG_IGN); // A dead worker should not kill the master
+
+  std::istringstream ss(workers);
+  std::string address;
+
+  while (std::getline(ss, address, ','))
+  {
+      int fd = open_socket(address, false);
+
+      if (fd == -1)
+      {
+          sync_cout << "info string Failed to connect to cluster worker " << address << sync_endl;
+          continue;
+      }
+
+      Workers.emplace_back(new Worker);
+      Workers.back()->address = address;
+      Workers.back()->fd = fd;
+      Workers.back()->reader = std::thread(read_loop, Workers.back().get());
+  }
+
+  sync_cout << "info string Cluster of " << Workers.size() << " workers" << sync_endl;
+}
+
+
+/// Cluster::serve() is called by the "cluster serve <address>" command. It waits
+/// for a master to connect, then redirects the standard input and output to the
+/// connection. It returns false if no master could connect.
+
+bool Cluster::serve(const std::string& address) {
+
+  int fd = open_socket(address, true);
+
+  if (fd == -1)
+  {
+      sync_cout << "info string Failed to listen on " << address << sync_endl;
+      return false;
+  }
+
+  sync_cout << "info string Waiting for the cluster master on " << address << sync_endl;
+
+  int conn = accept(fd, nullptr, nullptr);
+  close(fd);
+
+  if (address.find('/') != std::string::npos)
+      unlink(address.c_str());
+
+  if (conn == -1)
+      return false;
+
+  std::cout.flush();
+  dup2(conn, STDIN_FILENO);
+  dup2(conn, STDOUT_FILENO);
+  close(conn);
+  std::cin.clear();
+  return true;
+}
+
+
+/// Cluster::set_position() records the last "position" command, to be sent to
+/// the workers before their next search.
+
+void Cluster::set_position(const std::string& cmd) {
+  PositionCmd = cmd;
+}
+
+
+/// Cluster::split() is called by ThreadPool::start_thinking() on the root moves
+/// of a new search. The master keeps every (n+1)-th move, starting from the
+/// first one, and the other moves are dealt out to the n workers, which start
+/// searching them at once. Depth and node limits are passed on, otherwise the
+/// workers search until stopped by the master. Workers whose connection was
+/// lost are dropped first.
+
+void Cluster::split(const Search::LimitsType& limits, Search::RootMoves& rootMoves) {
+
+  Workers.erase(std::remove_if(Workers.begin(), Workers.end(),
+                               [](const std::unique_ptr<Worker>& w) {
+                                   std::lock_guard<Mutex> lk(w->mutex);
+                                   return w->dead;
+                               }), Workers.end());
+
+  if (   Workers.empty()
+      || rootMoves.size() < 2
+      || limits.perft
+      || Options["MultiPV"] != 1
+      || Options["Skill Level"] != 20)
+      return;
+
+  const size_t n = Workers.size() + 1;
+  std::vector<Search::RootMoves> shares(n);
+
+  for (size_t i = 0; i < rootMoves.size(); ++i)
+      shares[i % n].push_back(rootMoves[i]);
+
+  rootMoves = shares[0];
+
+  std::string go =  limits.depth ? "go depth " + std::to_string(limits.depth)
+                  : limits.nodes ? "go nodes " + std::to_string(limits.nodes)
+                                 : "go infinite";
+  StopWorkers = !limits.depth && !limits.nodes;
+
+  for (size_t i = 1; i < n; ++i)
+      if (!shares[i].empty())
+      {
+          Worker& w = *Workers[i - 1];
+          std::string moves;
+          bool alive;
+
+          for (const auto& rm : shares[i])
+              moves += " " + UCI::move(rm.pv[0]);
+
+          {
+              std::lock_guard<Mutex> lk(w.mutex);
+              alive = w.active = w.searching = !w.dead;
+              w.depth = 0;
+              w.score.clear(), w.pv.clear(), w.bestMove.clear(), w.ponder.clear();
+          }
+
+          if (alive)
+          {
+              send(w, PositionCmd);
+              send(w, go + " searchmoves" + moves);
+          }
+
+          // A worker lost before its search started leaves its share to the master
+          std::lock_guard<Mutex> lk(w.mutex);
+          if (w.dead)
+              rootMoves.insert(rootMoves.end(), shares[i].begin(), shares[i].end());
+      }
+}
+
+
+/// Cluster::stop() passes on a "stop" command to the searching workers
+
+void Cluster::stop() {
+
+  for (auto& w : Workers)
+  {
+      std::unique_lock<Mutex> lk(w->mutex);
+      bool searching = w->searching;
+      lk.unlock();
+
+      if (searching)
+          send(*w, "stop");
+  }
+}
+
+
+/// Cluster::send_best() is called by the master once its own search is over,
+/// with its best root move. It stops the workers if needed and waits for their
+/// best moves. If one of them has a better score, its PV and best move are sent
+/// to the GUI and the function returns true. Otherwise it returns false and the
+/// caller sends its own best move.
+
+bool Cluster::send_best(const Position&, const Search::RootMove& rm, Depth depth) {
+
+  const Worker* best = nullptr;
+  int bestScore = rm.score == -VALUE_INFINITE ? INT_MIN : to_cp(UCI::value(rm.score));
+  bool active = false;
+
+  for (auto& w : Workers)
+  {
+      std::unique_lock<Mutex> lk(w->mutex);
+
+      if (!w->active)
+          continue;
+
+      if (StopWorkers)
+      {
+          lk.unlock();
+          send(*w, "stop");
+          lk.lock();
+      }
+
+      w->cv.wait(lk, [&]{ return !w->searching; });
+
+      if (!w->active) // Lost while searching
+          continue;
+
+      w->active = false;
+      active = true;
+
+      if (!w->bestMove.empty() && !w->pv.empty() && to_cp(w->score) > bestScore)
+      {
+          best = w.get();
+          bestScore = to_cp(w->score);
+      }
+  }
+
+  if (!active)
+      return false;
+
+  sync_cout << "info string Cluster best move from "
+            << (best ? "worker " + best->address : "master")
+            << " at depth " << (best ? best->depth : depth / ONE_PLY) << sync_endl;
+
+  if (!best)
+      return false;
+
+  sync_cout << "info depth " << best->depth << " score " << best->score
+            << " pv " << best->pv << sync_endl;
+
+  sync_cout << "bestmove " << best->bestMove
+            << (best->ponder.empty() ? "" : " ponder " + best->ponder) << sync_endl;
+
+  return true;
+}
+
+#else // Windows: no cluster support yet
+
+void Cluster::connect(const std::string& workers) {
+
+  if (workers != "<empty>")
+      sync_cout << "info string Cluster mode is not supported on this platform" << sync_endl;
+}
+
+bool Cluster::serve(const std::string&) {
+
+  sync_cout << "info string Cluster mode is not supported on this platform" << sync_endl;
+  return false;
+}
+
+void Cluster::set_position(const std::string&) {}
+void Cluster::split(const Search::LimitsType&, Search::RootMoves&) {}
+void Cluster::stop() {}
+bool Cluster::send_best(const Position&, const Search::RootMove&, Depth) { return false; }
+
+#endif
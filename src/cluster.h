@@ -0,0 +1,53 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2017 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CLUSTER_H_INCLUDED
+#define CLUSTER_H_INCLUDED
+
+#include <string>
+
+#include "search.h"
+
+/// The Cluster namespace spreads a search over several engine processes, on
+/// the same host or not. A master engine, whose "Cluster Workers" option lists
+/// the addresses of the workers, keeps a share of the root moves for its own
+/// threads and hands out the others to the workers with "go ... searchmoves".
+/// Workers are ordinary engines that, after a "cluster serve <address>"
+/// command, read their UCI commands from the master connection and send their
+/// output back to it. When the search is over, the master compares the best
+/// move of each share and sends the overall best one to the GUI. An address
+/// is either a Unix socket path or a TCP "host:port" (just "port" to serve).
+/// There is no authentication: a served engine obeys whoever connects, and
+/// commands like "tt save <file>" write files. A bare port therefore listens
+/// on the loopback interface only, and serving on the network needs an
+/// explicit host, "0.0.0.0:port" or "[::]:port", on a trusted network only.
+
+namespace Cluster {
+
+void connect(const std::string& workers);
+bool serve(const std::string& address);
+void set_position(const std::string& cmd);
+void split(const Search::LimitsType& limits, Search::RootMoves& rootMoves);
+void stop();
+bool send_best(const Position& pos, const Search::RootMove& rm, Depth depth);
+
+} // namespace Cluster
+
+#endif // #ifndef CLUSTER_H_INCLUDED
@@ -44,8 +44,8 @@ int main(int argc, char* argv[]) {
   Search::init();
   Pawns::init();
   Tablebases::init(Options["SyzygyPath"]);
-  TT.resize(Options["Hash"]);
   Threads.init(Options["Threads"]);
+  TT.resize(Options["Hash"]); // After threads are up, to clear in parallel
   Search::clear(); // After threads are up
 
   UCI::loop(argc, argv);
@@ -36,6 +36,14 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#if defined(__linux__) && !defined(__ANDROID__)
+#include <sched.h>
+#include <sys/mman.h>
+#define HAS_HUGEPAGES
+#define HAS_AFFINITY
+#endif
+
+#include <cstdlib>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -44,6 +52,7 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 
 #include "misc.h"
 #include "thread.h"
+#include "uci.h"
 
 using namespace std;
 
@@ -211,9 +220,218 @@ void prefetch2(void* addr) {
   prefetch((uint8_t*)addr + 64);
 }
 
+
+#if defined(HAS_HUGEPAGES)
+namespace {
+
+  const size_t LargePageSize = 2 * 1024 * 1024;
+
+  size_t round_up(size_t size, size_t alignment) {
+    return (size + alignment - 1) & ~(alignment - 1);
+  }
+
+  // thp_mode() returns the transparent hugepage mode selected in the kernel,
+  // "always", "madvise" or "never", or an empty string if it can't be read.
+  std::string thp_mode() {
+
+    std::ifstream file("/sys/kernel/mm/transparent_hugepage/enabled");
+    std::string line;
+    std::getline(file, line);
+
+    size_t begin = line.find('['), end = line.find(']');
+    return begin != std::string::npos && end != std::string::npos && end > begin
+          ? line.substr(begin + 1, end - begin - 1) : "";
+  }
+}
+#endif
+
+/// aligned_large_alloc() allocates 'size' bytes aligned to a large page boundary.
+/// When 'largePages' is set we first try explicitly reserved 2MB hugepages
+/// (MAP_HUGETLB, see /proc/sys/vm/nr_hugepages), then transparent hugepages via
+/// madvise(), reported as such only if the kernel THP setting allows them. If
+/// neither is available we fall back on regular pages, so that the only
+/// observable difference is the number of TLB misses when probing. The kind of
+/// memory actually obtained is returned in 'backing' and must be passed back to
+/// aligned_large_free(). Returns nullptr on failure.
+
+void* aligned_large_alloc(size_t size, bool largePages, MemoryBacking& backing) {
+
+  void* mem = nullptr;
+
+#if defined(HAS_HUGEPAGES)
+
+  if (largePages)
+  {
+      size_t allocSize = round_up(size, LargePageSize);
+
+#  if defined(MAP_HUGETLB)
+      mem = mmap(nullptr, allocSize, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+
+      if (mem != MAP_FAILED)
+          return backing = EXPLICIT_HUGEPAGES, mem;
+#  endif
+
+      if (!posix_memalign(&mem, LargePageSize, allocSize))
+      {
+          // madvise() succeeds even when the kernel has THP set to "never"
+          if (!madvise(mem, allocSize, MADV_HUGEPAGE))
+          {
+              std::string mode = thp_mode();
+              backing =  mode == "always" || mode == "madvise" ? TRANSPARENT_HUGEPAGES
+                       : mode == "never"                       ? SMALL_PAGES
+                                                               : REQUESTED_HUGEPAGES;
+              return mem;
+          }
+
+          free(mem);
+      }
+  }
+
+#else
+  (void)largePages;
+#endif
+
+  backing = SMALL_PAGES;
+
+#if defined(_WIN32)
+  mem = _aligned_malloc(size, 64);
+#else
+  if (posix_memalign(&mem, 64, size))
+      mem = nullptr;
+#endif
+
+  return mem;
+}
+
+
+/// aligned_large_free() releases memory obtained by aligned_large_alloc()
+
+void aligned_large_free(void* mem, size_t size, MemoryBacking backing) {
+
+  if (!mem)
+      return;
+
+#if defined(HAS_HUGEPAGES)
+  if (backing == EXPLICIT_HUGEPAGES)
+  {
+      munmap(mem, round_up(size, LargePageSize));
+      return;
+  }
+#else
+  (void)size, (void)backing;
+#endif
+
+#if defined(_WIN32)
+  _aligned_free(mem);
+#else
+  free(mem);
+#endif
+}
+
+
+/// to_string() returns a human readable description of a MemoryBacking
+
+const char* to_string(MemoryBacking backing) {
+
+  return backing == SHARED_MEMORY         ? "shared memory"
+       : backing == MAPPED_FILE           ? "a memory-mapped file"
+       : backing == EXPLICIT_HUGEPAGES    ? "explicit 2MB hugepages (MAP_HUGETLB)"
+       : backing == TRANSPARENT_HUGEPAGES ? "transparent hugepages (madvise)"
+       : backing == REQUESTED_HUGEPAGES   ? "transparent hugepages requested (madvise), kernel setting unknown"
+                                          : "regular pages";
+}
+
 namespace WinProcGroup {
 
-#ifndef _WIN32
+#if defined(HAS_AFFINITY)
+
+/// parse_cpulist() converts a list of logical processors in the Linux format,
+/// e.g. "0-7,16-23", into a vector. Invalid items are skipped.
+
+std::vector<int> parse_cpulist(const std::string& list) {
+
+  std::vector<int> cpus;
+  std::istringstream ss(list);
+  std::string item;
+
+  while (std::getline(ss, item, ','))
+  {
+      int first, last;
+      char dash;
+      std::istringstream is(item);
+
+      if (!(is >> first))
+          continue;
+
+      if (!(is >> dash >> last) || dash != '-')
+          last = first;
+
+      for (int cpu = first; cpu <= last && cpu < CPU_SETSIZE; ++cpu)
+          cpus.push_back(cpu);
+  }
+
+  return cpus;
+}
+
+
+/// get_cpus() returns the logical processors the thread with index idx should
+/// run on, according to the "Thread Affinity" option, or an empty vector to let
+/// the OS decide. With "numa" the threads are dealt out in turn to the NUMA
+/// nodes listed in sysfs and may run on any processor of their node. With a
+/// list of processors each thread is pinned to one of them, in order.
+
+std::vector<int> get_cpus(size_t idx) {
+
+  std::string affinity = Options["Thread Affinity"];
+  std::vector<int> cpus;
+
+  if (affinity == "numa")
+  {
+      std::vector<std::vector<int>> nodes;
+      std::string list;
+
+      for (int n = 0; std::getline(std::ifstream("/sys/devices/system/node/node"
+                                   + std::to_string(n) + "/cpulist"), list); ++n)
+      {
+          std::vector<int> node = parse_cpulist(list);
+
+          if (!node.empty()) // Skip memory-only nodes
+              nodes.push_back(node);
+      }
+
+      if (nodes.size() > 1)
+          cpus = nodes[idx % nodes.size()];
+  }
+  else if (affinity != "<empty>")
+  {
+      std::vector<int> list = parse_cpulist(affinity);
+
+      if (!list.empty())
+          cpus.push_back(list[idx % list.size()]);
+  }
+
+  return cpus;
+}
+
+
+/// bindThisThread() sets the affinity of the current thread. As memory pages
+/// are physically allocated on the node of the thread that first writes them,
+/// a thread should be bound before it initializes its data.
+
+void bindThisThread(size_t idx) {
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+
+  for (int cpu : get_cpus(idx))
+      CPU_SET(cpu, &set);
+
+  if (CPU_COUNT(&set))
+      sched_setaffinity(0, sizeof(set), &set); // 0 is the calling thread
+}
+
+#elif !defined(_WIN32)
 
 void bindThisThread(size_t) {}
 
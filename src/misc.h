@@ -34,6 +34,13 @@ void prefetch(void* addr);
 void prefetch2(void* addr);
 void start_logger(const std::string& fname);
 
+/// Backing store of memory obtained through aligned_large_alloc()
+enum MemoryBacking { SMALL_PAGES, TRANSPARENT_HUGEPAGES, REQUESTED_HUGEPAGES, EXPLICIT_HUGEPAGES, MAPPED_FILE, SHARED_MEMORY };
+
+void* aligned_large_alloc(size_t size, bool largePages, MemoryBacking& backing);
+void aligned_large_free(void* mem, size_t size, MemoryBacking backing);
+const char* to_string(MemoryBacking backing);
+
 void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
 void dbg_mean_of(int v);
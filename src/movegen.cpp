@@ -170,12 +170,89 @@ namespace {
   }
 
 
+#ifdef BULK_MOVEGEN
+
+  // With bulkgen=yes in the Makefile (BULK_MOVEGEN) the moves of the leapers,
+  // Alfil (BISHOP), Fers (QUEEN), Knight and King, are generated for all the
+  // pieces of a type at once, one jump direction after the other: the bitboard
+  // of the pieces is shifted by the jump and the moves are read back from the
+  // destinations, instead of looking up the attacks of each piece in turn.
+
+  // leap() shifts a bitboard by the jump D, dropping the squares that would
+  // wrap around the A or H file.
+  template<int D>
+  Bitboard leap(Bitboard b) {
+
+    const int F = ((D + 2) & 7) - 2; // File delta of the jump, from -2 to 2
+    const Bitboard Edges =  F ==  2 ? FileGBB | FileHBB : F ==  1 ? FileHBB
+                          : F == -2 ? FileABB | FileBBB : F == -1 ? FileABB : 0;
+
+    return D > 0 ? (b & ~Edges) << D : (b & ~Edges) >> -D;
+  }
+
+
+  template<int D>
+  ExtMove* splat_leap(ExtMove* moveList, Bitboard from, Bitboard target) {
+
+    Bitboard b = leap<D>(from) & target;
+
+    while (b)
+    {
+        Square to = pop_lsb(&b);
+        *moveList++ = make_move(to - Square(D), to);
+    }
+
+    return moveList;
+  }
+
+
+  template<int... Ds>
+  ExtMove* splat_leaps(ExtMove* moveList, Bitboard from, Bitboard target) {
+
+    using expand = int[]; // Calls splat_leap() for each jump, in order
+    (void)expand{ 0, (moveList = splat_leap<Ds>(moveList, from, target), 0)... };
+
+    return moveList;
+  }
+
+
+  template<PieceType Pt, bool Checks>
+  ExtMove* generate_leaper_moves(const Position& pos, ExtMove* moveList, Color us,
+                                 Bitboard target) {
+
+    Bitboard from = pos.pieces(us, Pt);
+
+    if (Checks)
+    {
+        from &= ~pos.discovered_check_candidates();
+        target &= pos.check_squares(Pt);
+    }
+
+    return Pt == BISHOP ? splat_leaps<14, 18, -14, -18>(moveList, from, target)
+         : Pt == QUEEN  ? splat_leaps< 7,  9,  -7,  -9>(moveList, from, target)
+         : Pt == KNIGHT ? splat_leaps< 6, 10, 15, 17, -6, -10, -15, -17>(moveList, from, target)
+                        : splat_leaps< 1,  7,  8,  9, -1,  -7,  -8,  -9>(moveList, from, target);
+  }
+
+#endif
+
+
   template<Color Us, GenType Type>
   ExtMove* generate_all(const Position& pos, ExtMove* moveList, Bitboard target) {
 
     const bool Checks = Type == QUIET_CHECKS;
 
     moveList = generate_pawn_moves<Us, Type>(pos, moveList, target);
+
+#ifdef BULK_MOVEGEN
+    moveList = generate_leaper_moves<BISHOP, Checks>(pos, moveList, Us, target);
+    moveList = generate_leaper_moves< QUEEN, Checks>(pos, moveList, Us, target);
+    moveList = generate_leaper_moves<KNIGHT, Checks>(pos, moveList, Us, target);
+    moveList = generate_moves<  ROOK, Checks>(pos, moveList, Us, target);
+
+    if (Type != QUIET_CHECKS && Type != EVASIONS)
+        moveList = generate_leaper_moves<KING, false>(pos, moveList, Us, target);
+#else
     moveList = generate_moves<BISHOP, Checks>(pos, moveList, Us, target);
     moveList = generate_moves< QUEEN, Checks>(pos, moveList, Us, target);
     moveList = generate_moves<KNIGHT, Checks>(pos, moveList, Us, target);
@@ -188,6 +265,7 @@ namespace {
         while (b)
             *moveList++ = make_move(ksq, pop_lsb(&b));
     }
+#endif
 
     return moveList;
   }
@@ -21,6 +21,8 @@
 #include <cassert>
 
 #include "movepick.h"
+#include "thread.h"
+#include "tt.h"
 
 namespace {
 
@@ -33,6 +35,12 @@ namespace {
     QSEARCH_RECAPTURES, QRECAPTURES
   };
 
+  // The TT clusters of the child positions are prefetched for the moves which
+  // are up to PrefetchWindow places ahead of the current one, when the order of
+  // the moves is known in advance, to overlap the latency of the TT probes with
+  // the search of the moves in between.
+  const int PrefetchWindow = 4;
+
   // partial_insertion_sort() sorts moves in descending order up to and including
   // a given limit. The order of moves smaller than the limit is left unspecified.
   void partial_insertion_sort(ExtMove* begin, ExtMove* end, int limit) {
@@ -57,6 +65,23 @@ namespace {
     return *begin;
   }
 
+  // check_tt_move() returns the TT move if it is pseudo legal, otherwise it
+  // returns MOVE_NONE. As the TT move always comes from a TT hit, an illegal
+  // one reveals a key collision (or a torn entry) and is counted. This is only
+  // a lower bound on the false hits: colliding entries without a move, or
+  // with a move that happens to be legal here, go unnoticed.
+  Move check_tt_move(const Position& pos, Move ttm) {
+
+    if (!ttm)
+        return MOVE_NONE;
+
+    if (pos.pseudo_legal(ttm))
+        return ttm;
+
+    pos.this_thread()->ttFalseHits.fetch_add(1, std::memory_order_relaxed);
+    return MOVE_NONE;
+  }
+
 } // namespace
 
 
@@ -75,7 +100,7 @@ MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHist
   assert(d > DEPTH_ZERO);
 
   stage = pos.checkers() ? EVASION : MAIN_SEARCH;
-  ttMove = ttm && pos.pseudo_legal(ttm) ? ttm : MOVE_NONE;
+  ttMove = check_tt_move(pos, ttm);
   stage += (ttMove == MOVE_NONE);
 }
 
@@ -101,7 +126,7 @@ MovePicker::MovePicker(const Position& p, Move ttm, Depth d, const ButterflyHist
       return;
   }
 
-  ttMove = ttm && pos.pseudo_legal(ttm) ? ttm : MOVE_NONE;
+  ttMove = check_tt_move(pos, ttm);
   stage += (ttMove == MOVE_NONE);
 }
 
@@ -113,14 +138,32 @@ MovePicker::MovePicker(const Position& p, Move ttm, Value th)
   assert(!pos.checkers());
 
   stage = PROBCUT;
+  ttm = check_tt_move(pos, ttm);
   ttMove =   ttm
-          && pos.pseudo_legal(ttm)
           && pos.capture(ttm)
           && pos.see_ge(ttm, threshold) ? ttm : MOVE_NONE;
 
   stage += (ttMove == MOVE_NONE);
 }
 
+/// prefetch_tt() prefetches the TT cluster of the position reached by the move
+/// at m, if any. prefetch_window() does it for the next PrefetchWindow moves.
+void MovePicker::prefetch_tt(const ExtMove* m) const {
+
+#ifndef NO_PREFETCH
+  if (m < endMoves)
+      prefetch(TT.first_entry(pos.key_after(*m)));
+#else
+  (void)m;
+#endif
+}
+
+void MovePicker::prefetch_window() const {
+
+  for (int i = 0; i < PrefetchWindow; ++i)
+      prefetch_tt(cur + i);
+}
+
 /// score() assigns a numerical value to each move in a list, used for sorting.
 /// Captures are ordered by Most Valuable Victim (MVV), preferring captures
 /// near our home rank. Quiets are ordered using the histories.
@@ -170,6 +213,8 @@ Move MovePicker::next_move(bool skipQuiets) {
       endBadCaptures = cur = moves;
       endMoves = generate<CAPTURES>(pos, cur);
       score<CAPTURES>();
+      if (endMoves - cur <= PrefetchWindow) // Picked in any order, see pick_best()
+          prefetch_window();
       ++stage;
       /* fallthrough */
 
@@ -223,6 +268,7 @@ Move MovePicker::next_move(bool skipQuiets) {
       endMoves = generate<QUIETS>(pos, cur);
       score<QUIETS>();
       partial_insertion_sort(cur, endMoves, -4000 * depth / ONE_PLY);
+      prefetch_window();
       ++stage;
       /* fallthrough */
 
@@ -230,6 +276,7 @@ Move MovePicker::next_move(bool skipQuiets) {
       while (    cur < endMoves
              && (!skipQuiets || cur->value >= VALUE_ZERO))
       {
+          prefetch_tt(cur + PrefetchWindow);
           move = *cur++;
 
           if (   move != ttMove
@@ -284,6 +331,8 @@ Move MovePicker::next_move(bool skipQuiets) {
       cur = moves;
       endMoves = generate<CAPTURES>(pos, cur);
       score<CAPTURES>();
+      if (endMoves - cur <= PrefetchWindow)
+          prefetch_window();
       ++stage;
       /* fallthrough */
 
@@ -298,12 +347,14 @@ Move MovePicker::next_move(bool skipQuiets) {
           break;
       cur = moves;
       endMoves = generate<QUIET_CHECKS>(pos, cur);
+      prefetch_window();
       ++stage;
       /* fallthrough */
 
   case QCHECKS:
       while (cur < endMoves)
       {
+          prefetch_tt(cur + PrefetchWindow);
           move = cur++->move;
           if (move != ttMove)
               return move;
@@ -22,13 +22,31 @@
 #define MOVEPICK_H_INCLUDED
 
 #include <array>
+#include <atomic>
 
 #include "movegen.h"
 #include "position.h"
 #include "types.h"
 
+/// Relaxed is a statistic that the search threads may update at the same time,
+/// see "Shared History". Its loads and stores are atomic, so that a concurrent
+/// update can be lost but is never torn, and relaxed, so that they compile to
+/// plain moves.
+template<typename T>
+struct Relaxed {
+
+  Relaxed(T v = T()) : a(v) {}
+  Relaxed(const Relaxed& r) : a(T(r)) {}
+  Relaxed& operator=(const Relaxed& r) { return *this = T(r); }
+  Relaxed& operator=(T v) { a.store(v, std::memory_order_relaxed); return *this; }
+  operator T() const { return a.load(std::memory_order_relaxed); }
+
+private:
+  std::atomic<T> a;
+};
+
 /// StatBoards is a generic 2-dimensional array used to store various statistics
-template<int Size1, int Size2, typename T = int16_t>
+template<int Size1, int Size2, typename T = Relaxed<int16_t>>
 struct StatBoards : public std::array<std::array<T, Size2>, Size1> {
 
   void fill(const T& v) {
@@ -41,9 +59,11 @@ struct StatBoards : public std::array<std::array<T, Size2>, Size1> {
     assert(abs(bonus) <= D); // Ensure range is [-32 * D, 32 * D]
     assert(abs(32 * D) < INT16_MAX); // Ensure we don't overflow
 
-    entry += bonus * 32 - entry * abs(bonus) / D;
+    int e = entry; // Read it once, other threads may update it too
+    e += bonus * 32 - e * abs(bonus) / D;
+    entry = int16_t(e);
 
-    assert(abs(entry) <= 32 * D);
+    assert(abs(e) <= 32 * D);
   }
 };
 
@@ -74,7 +94,7 @@ struct PieceToHistory : public PieceToBoards {
 
 /// CounterMoveHistory stores counter moves indexed by [piece][to] of the previous
 /// move, see chessprogramming.wikispaces.com/Countermove+Heuristic
-typedef StatBoards<PIECE_NB, SQUARE_NB, Move> CounterMoveHistory;
+typedef StatBoards<PIECE_NB, SQUARE_NB, Relaxed<Move>> CounterMoveHistory;
 
 /// ContinuationHistory is the history of a given pair of moves, usually the
 /// current one given a previous one. History table is based on PieceToBoards
@@ -97,9 +117,12 @@ public:
   MovePicker(const Position&, Move, Depth, const ButterflyHistory*, Square);
   MovePicker(const Position&, Move, Depth, const ButterflyHistory*, const PieceToHistory**, Move, Move*);
   Move next_move(bool skipQuiets = false);
+  int stage_reached() const { return stage; }
 
 private:
   template<GenType> void score();
+  void prefetch_tt(const ExtMove* m) const;
+  void prefetch_window() const;
   ExtMove* begin() { return cur; }
   ExtMove* end() { return endMoves; }
 
@@ -0,0 +1,382 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2017 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>   // For std::memset
+#include <iostream>
+#include <vector>
+
+#include "bitboard.h"
+#include "misc.h"
+#include "movegen.h"
+#include "perft.h"
+#include "position.h"
+#include "uci.h"
+
+namespace {
+
+#ifdef COPY_MAKE
+
+  // With copy-make (copymake=yes) perft doesn't walk the tree with Position,
+  // but with Board, a position made only of bitboards. Plane i holds bit i of
+  // the piece code of each square, so that the pieces take 32 bytes. A move is
+  // made into a copy of the board and there is no undo: the parent board is
+  // still there. Legality is tested by looking for attacks on our king after
+  // the move, only for the moves that may leave it in check.
+  struct Board {
+
+    void set(const Position& pos);
+    void do_move(Move m, Board& child) const;
+    template<bool CountOnly> int generate(Move* moveList) const;
+
+    Bitboard pieces() const { return plane[0] | plane[1] | plane[2]; }
+    Bitboard pieces(Color c) const { return c == WHITE ? pieces() & ~plane[3] : plane[3]; }
+    Bitboard pieces(PieceType pt) const {
+      return  (pt & 1 ? plane[0] : ~plane[0])
+            & (pt & 2 ? plane[1] : ~plane[1])
+            & (pt & 4 ? plane[2] : ~plane[2]);
+    }
+    Bitboard pieces(Color c, PieceType pt) const { return pieces(c) & pieces(pt); }
+    Piece piece_on(Square s) const {
+      return Piece(  ((plane[0] >> s) & 1)       | (((plane[1] >> s) & 1) << 1)
+                   | (((plane[2] >> s) & 1) << 2) | (((plane[3] >> s) & 1) << 3));
+    }
+    Bitboard attackers_to(Square s, Color c, Bitboard occupied) const;
+
+    Bitboard plane[4];
+    Key key;
+    Color sideToMove;
+  };
+
+  static_assert(sizeof(Board::plane) == 32, "Board planes size incorrect");
+
+  void Board::set(const Position& pos) {
+
+    std::memset(plane, 0, sizeof(plane));
+
+    for (Bitboard b = pos.pieces(); b; )
+    {
+        Square s = pop_lsb(&b);
+        for (int i = 0; i < 4; ++i)
+            if (pos.piece_on(s) & (1 << i))
+                plane[i] |= s;
+    }
+
+    key = pos.key();
+    sideToMove = pos.side_to_move();
+  }
+
+  void Board::do_move(Move m, Board& child) const {
+
+    Square from = from_sq(m), to = to_sq(m);
+    Piece pc = piece_on(from), captured = piece_on(to);
+    Piece newPc = type_of(m) == PROMOTION ? make_piece(sideToMove, promotion_type(m)) : pc;
+    Bitboard fromTo = SquareBB[from] | SquareBB[to];
+
+    for (int i = 0; i < 4; ++i)
+        child.plane[i] = (plane[i] & ~fromTo) | (Bitboard((newPc >> i) & 1) << to);
+
+    child.key = key ^ Zobrist::psq[pc][from] ^ Zobrist::psq[newPc][to] ^ Zobrist::side;
+    if (captured)
+        child.key ^= Zobrist::psq[captured][to];
+
+    child.sideToMove = ~sideToMove;
+  }
+
+  // Board::attackers_to() returns the pieces of color c attacking square s,
+  // like Position::attackers_to().
+  Bitboard Board::attackers_to(Square s, Color c, Bitboard occupied) const {
+
+    return (  (PawnAttacks[~c][s]            & pieces(PAWN))
+            | (PseudoAttacks[BISHOP][s]      & pieces(BISHOP))
+            | (PseudoAttacks[QUEEN][s]       & pieces(QUEEN))
+            | (PseudoAttacks[KNIGHT][s]      & pieces(KNIGHT))
+            | (attacks_bb<ROOK>(s, occupied) & pieces(ROOK))
+            | (PseudoAttacks[KING][s]        & pieces(KING))) & pieces(c);
+  }
+
+  // Board::generate() writes the legal moves to moveList, the same ones as
+  // generate<LEGAL>() with Position, and returns their number. When CountOnly
+  // is set, the moves are only counted and moveList is not used.
+  template<bool CountOnly>
+  int Board::generate(Move* moveList) const {
+
+    Color us = sideToMove, them = ~us;
+    Bitboard occupied = pieces(), own = pieces(us), enemies = pieces(them);
+    Square ksq = lsb(pieces(us, KING));
+    int cnt = 0;
+
+    // A bare king may only capture the last piece of the other side
+    bool bare = !more_than_one(own);
+    if (bare && popcount(enemies) > 2)
+        return 0;
+
+    Bitboard target = bare ? enemies : ~own;
+
+    // Test king moves, all moves when in check and otherwise the moves of our
+    // pieces alone between our king and an enemy rook, the only slider.
+    Bitboard suspects = SquareBB[ksq];
+
+    if (attackers_to(ksq, them, occupied))
+        suspects = own;
+    else
+        for (Bitboard snipers = PseudoAttacks[ROOK][ksq] & pieces(them, ROOK); snipers; )
+        {
+            Bitboard b = between_bb(ksq, pop_lsb(&snipers)) & occupied;
+            if (!more_than_one(b))
+                suspects |= b & own;
+        }
+
+    auto add = [&](Square from, Bitboard to, bool promotion) {
+
+        if (suspects & from)
+            for (Bitboard b = to; b; )
+            {
+                Square s = pop_lsb(&b);
+                if (attackers_to(from == ksq ? s : ksq, them, (occupied ^ from) | s) & ~SquareBB[s])
+                    to ^= s;
+            }
+
+        if (CountOnly)
+            cnt += popcount(to);
+        else
+            while (to)
+                moveList[cnt++] = promotion ? make<PROMOTION>(from, pop_lsb(&to), QUEEN)
+                                            : make_move(from, pop_lsb(&to));
+    };
+
+    for (Bitboard b = pieces(us, PAWN); b; )
+    {
+        Square from = pop_lsb(&b);
+        add(from, ((PawnAttacks[us][from] & enemies) | (SquareBB[from + pawn_push(us)] & ~occupied)) & target,
+            relative_rank(us, from) == RANK_7);
+    }
+
+    for (PieceType pt : { BISHOP, QUEEN, KNIGHT, ROOK, KING })
+        for (Bitboard b = pieces(us, pt); b; )
+        {
+            Square from = pop_lsb(&b);
+            add(from, attacks_bb(pt, from, occupied) & target, false);
+        }
+
+    return cnt;
+  }
+
+#endif
+
+  // An entry stores the leaf count of a subtree together with its depth, and
+  // the key XORed with both of them. Threads read and write the entries
+  // without locking, so an entry torn by two concurrent writes simply fails
+  // the key check and is treated as a miss.
+  struct Entry {
+    Key key;
+    uint64_t data; // Count in the upper 56 bits, depth in the lower 8 bits
+  };
+
+  // The first entry of a cluster keeps the deepest subtree, the second one
+  // is always replaced.
+  struct Cluster {
+    Entry entry[2];
+  };
+
+  static_assert(sizeof(Cluster) == 32, "Cluster size incorrect");
+
+  // The table lives only for the run, next to the transposition table
+  const size_t MaxTableMB = 256;
+
+  Cluster* table;
+  size_t clusterCount;
+  MemoryBacking backing;
+
+  int rootDepth;
+  std::vector<Move> rootMoves;
+  std::vector<uint64_t> rootCounts;
+  std::atomic<size_t> nextRootMove;
+
+  bool probe(Key key, int depth, uint64_t& cnt) {
+
+    Cluster& c = table[key & (clusterCount - 1)];
+
+    for (const Entry& e : c.entry)
+    {
+        uint64_t data = e.data;
+        if ((e.key ^ data) == key && int(data & 0xFF) == depth)
+        {
+            cnt = data >> 8;
+            return true;
+        }
+    }
+    return false;
+  }
+
+  void store(Key key, int depth, uint64_t cnt) {
+
+    Cluster& c = table[key & (clusterCount - 1)];
+    Entry& e = depth >= int(c.entry[0].data & 0xFF) ? c.entry[0] : c.entry[1];
+    uint64_t data = (cnt << 8) | uint64_t(depth);
+
+    e.key = key ^ data;
+    e.data = data;
+  }
+
+  // perft() returns the number of leaf nodes at the given depth, which must
+  // be at least one. At depth one the legal moves are just counted.
+#ifdef COPY_MAKE
+  uint64_t perft(const Board& board, int depth) {
+
+    Move moves[MAX_MOVES];
+
+    if (depth == 1)
+        return board.generate<true>(moves);
+
+    uint64_t nodes = 0;
+    if (table && probe(board.key, depth, nodes))
+        return nodes;
+
+    Board child;
+    int cnt = board.generate<false>(moves);
+
+    for (int i = 0; i < cnt; ++i)
+    {
+        board.do_move(moves[i], child);
+        nodes += perft(child, depth - 1);
+    }
+
+    if (table)
+        store(board.key, depth, nodes);
+    return nodes;
+  }
+#else
+  uint64_t perft(Position& pos, int depth) {
+
+    if (depth == 1)
+        return MoveList<LEGAL>(pos).size();
+
+    uint64_t nodes = 0;
+    if (table && probe(pos.key(), depth, nodes))
+        return nodes;
+
+    StateInfo st;
+    for (const auto& m : MoveList<LEGAL>(pos))
+    {
+        pos.do_move(m, st);
+        nodes += perft(pos, depth - 1);
+        pos.undo_move(m);
+    }
+
+    if (table)
+        store(pos.key(), depth, nodes);
+    return nodes;
+  }
+#endif
+
+} // namespace
+
+
+/// Perft::start() is called by the main thread before waking up the other
+/// ones. It sets up the list of root moves to share out and allocates the hash
+/// table, sized by the "Hash" option up to MaxTableMB. When the allocation
+/// fails, perft runs without a table.
+
+void Perft::start(const Position& pos, Depth depth) {
+
+  rootDepth = std::min(int(depth / ONE_PLY), 255);
+  rootMoves.clear();
+
+  for (const auto& m : MoveList<LEGAL>(pos))
+      rootMoves.push_back(m);
+
+  rootCounts.assign(rootMoves.size(), 0);
+  nextRootMove = 0;
+
+  if (rootDepth < 3) // No subtree is probed
+      return;
+
+  size_t mbSize = std::min(size_t(Options["Hash"]), MaxTableMB);
+  clusterCount = size_t(1) << msb((mbSize * 1024 * 1024) / sizeof(Cluster));
+  table = (Cluster*)aligned_large_alloc(clusterCount * sizeof(Cluster), Options["Large Pages"], backing);
+
+  if (!table)
+  {
+      sync_cout << "info string Failed to allocate " << mbSize
+                << "MB for the perft hash table, running without it" << sync_endl;
+      return;
+  }
+
+  std::memset(table, 0, clusterCount * sizeof(Cluster));
+}
+
+
+/// Perft::search() is called by every thread with its own copy of the root
+/// position. It picks the next root move not taken yet by another thread
+/// until there are none left.
+
+void Perft::search(Position& pos) {
+
+#ifdef COPY_MAKE
+  Board root, child;
+  root.set(pos);
+#else
+  StateInfo st;
+#endif
+  size_t idx;
+
+  while ((idx = nextRootMove++) < rootMoves.size())
+  {
+      if (rootDepth <= 1)
+      {
+          rootCounts[idx] = 1;
+          continue;
+      }
+
+#ifdef COPY_MAKE
+      root.do_move(rootMoves[idx], child);
+      rootCounts[idx] = perft(child, rootDepth - 1);
+#else
+      pos.do_move(rootMoves[idx], st);
+      rootCounts[idx] = perft(pos, rootDepth - 1);
+      pos.undo_move(rootMoves[idx]);
+#endif
+  }
+}
+
+
+/// Perft::finish() is called by the main thread once all the threads are
+/// done. It frees the hash table, returns the total count and, when dividing,
+/// prints the count of each root move.
+
+uint64_t Perft::finish(bool divide) {
+
+  uint64_t nodes = 0;
+
+  aligned_large_free(table, clusterCount * sizeof(Cluster), backing);
+  table = nullptr;
+
+  for (size_t i = 0; i < rootMoves.size(); ++i)
+  {
+      if (divide)
+          sync_cout << UCI::move(rootMoves[i]) << ": " << rootCounts[i] << sync_endl;
+      nodes += rootCounts[i];
+  }
+
+  return nodes;
+}
@@ -0,0 +1,49 @@
+/*
+  Stockfish, a UCI chess playing engine derived from Glaurung 2.1
+  Copyright (C) 2004-2008 Tord Romstad (Glaurung author)
+  Copyright (C) 2008-2015 Marco Costalba, Joona Kiiski, Tord Romstad
+  Copyright (C) 2015-2017 Marco Costalba, Joona Kiiski, Gary Linscott, Tord Romstad
+
+  Stockfish is free software: you can redistribute it and/or modify
+  it under the terms of the GNU General Public License as published by
+  the Free Software Foundation, either version 3 of the License, or
+  (at your option) any later version.
+
+  Stockfish is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License
+  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef PERFT_H_INCLUDED
+#define PERFT_H_INCLUDED
+
+#include <cstdint>
+
+#include "types.h"
+
+class Position;
+
+/// The Perft namespace counts the leaf nodes of the legal move tree up to a
+/// given depth, our utility to verify move generation. The root moves are
+/// handed out one at a time to the search threads, the moves of the last ply
+/// are counted without being made, and the counts of the inner subtrees are
+/// kept in a hash table, allocated for the run and sized by the "Hash" option up
+/// to a cap, so that a subtree reached through a transposition is counted only
+/// once. With "go perft <depth> divide"
+/// the count of each root move is printed too, to find which subtree holds a
+/// move generation bug.
+
+namespace Perft {
+
+void start(const Position& pos, Depth depth);
+void search(Position& pos);
+uint64_t finish(bool divide);
+
+} // namespace Perft
+
+#endif // #ifndef PERFT_H_INCLUDED
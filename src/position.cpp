@@ -21,7 +21,7 @@
 #include <algorithm>
 #include <cassert>
 #include <cstddef> // For offsetof()
-#include <cstring> // For std::memset, std::memcmp
+#include <cstring> // For std::memcpy, std::memset, std::memcmp
 #include <iomanip>
 #include <sstream>
 
@@ -307,6 +307,21 @@ Position& Position::set(const string& code, Color c, StateInfo* si) {
 }
 
 
+/// Position::set() is an overload to copy the given position, for the given
+/// thread. The copy shares the current StateInfo with the original, so that
+/// also the fields that cannot be deduced from a FEN string are kept.
+
+Position& Position::set(const Position& pos, Thread* th) {
+
+  std::memcpy(static_cast<void*>(this), &pos, sizeof(Position));
+  thisThread = th;
+
+  assert(pos_is_ok());
+
+  return *this;
+}
+
+
 /// Position::fen() returns a FEN representation of the position. In case of
 /// Chess960 the Shredder-FEN notation is used. This is mainly a debugging function.
 
@@ -30,6 +30,16 @@
 #include "types.h"
 
 
+/// Zobrist keys hashing the positions, initialized by Position::init(). Perft
+/// with copy-make hashes its own boards with them too.
+
+namespace Zobrist {
+
+  extern Key psq[PIECE_NB][SQUARE_NB];
+  extern Key side, noPawns;
+}
+
+
 /// StateInfo struct stores information needed to restore a Position object to
 /// its previous state when we retract a move. Whenever a move is made on the
 /// board (by calling Position::do_move), a StateInfo object must be passed.
@@ -78,6 +88,7 @@ public:
   // FEN string input/output
   Position& set(const std::string& fenStr, bool isChess960, StateInfo* si, Thread* th);
   Position& set(const std::string& code, Color c, StateInfo* si);
+  Position& set(const Position& pos, Thread* th);
   const std::string fen() const;
 
   // Position representation
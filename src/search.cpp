@@ -19,16 +19,20 @@
 */
 
 #include <algorithm>
+#include <array>
 #include <cassert>
 #include <cmath>
 #include <cstring>   // For std::memset
 #include <iostream>
+#include <map>
 #include <sstream>
 
+#include "cluster.h"
 #include "evaluate.h"
 #include "misc.h"
 #include "movegen.h"
 #include "movepick.h"
+#include "perft.h"
 #include "position.h"
 #include "search.h"
 #include "timeman.h"
@@ -135,6 +139,64 @@ namespace {
     Move pv[3];
   };
 
+  // Cooperative search, see the "Cooperative Search" option. The nodes near the
+  // root that are being searched are recorded in a small lockless table, so
+  // that the other threads can defer the moves leading to them, in the spirit
+  // of ABDADA. Deferred moves are searched after all the others, hopefully by
+  // then with the result of the first thread in the TT, and with the move count
+  // they had in the move ordering, so that they are not pruned or reduced more.
+  const int CoopMaxPly = 8;
+  const int MaxDeferred = 32;
+  bool Cooperative;
+
+  struct Breadcrumb {
+    std::atomic<Thread*> thread;
+    std::atomic<Key> key;
+    std::atomic<int> depth;
+  };
+
+  std::array<Breadcrumb, 1024> Breadcrumbs;
+
+  // ThreadHolding marks a node as being searched by a thread for its lifetime,
+  // unless its breadcrumb is already taken
+  struct ThreadHolding {
+
+    ThreadHolding(Thread* thisThread, Key posKey, Depth depth, bool mark) : owning(false) {
+
+      location = &Breadcrumbs[posKey & (Breadcrumbs.size() - 1)];
+      Thread* expected = nullptr;
+
+      if (   mark
+          && !location->thread.load(std::memory_order_relaxed)
+          &&  location->thread.compare_exchange_strong(expected, thisThread))
+      {
+          location->key.store(posKey, std::memory_order_relaxed);
+          location->depth.store(depth, std::memory_order_relaxed);
+          owning = true;
+      }
+    }
+
+   ~ThreadHolding() {
+      if (owning)
+          location->thread.store(nullptr, std::memory_order_relaxed);
+    }
+
+    Breadcrumb* location;
+    bool owning;
+  };
+
+  // searched_by_other() returns true if another thread is searching the given
+  // node at the given depth or more
+  bool searched_by_other(Thread* thisThread, Key key, Depth depth) {
+
+    const Breadcrumb& b = Breadcrumbs[key & (Breadcrumbs.size() - 1)];
+    Thread* th = b.thread.load(std::memory_order_relaxed);
+
+    return   th && th != thisThread
+          && b.key.load(std::memory_order_relaxed) == key
+          && b.depth.load(std::memory_order_relaxed) >= depth;
+  }
+
   EasyMoveManager EasyMove;
   Value DrawValue[COLOR_NB];
 
@@ -149,32 +211,7 @@ namespace {
   void update_pv(Move* pv, Move move, Move* childPv);
   void update_continuation_histories(Stack* ss, Piece pc, Square to, int bonus);
   void update_stats(const Position& pos, Stack* ss, Move move, Move* quiets, int quietsCnt, int bonus);
-
-  // perft() is our utility to verify move generation. All the leaf nodes up
-  // to the given depth are generated and counted, and the sum is returned.
-  template<bool Root>
-  uint64_t perft(Position& pos, Depth depth) {
-
-    StateInfo st;
-    uint64_t cnt, nodes = 0;
-    const bool leaf = (depth == 2 * ONE_PLY);
-
-    for (const auto& m : MoveList<LEGAL>(pos))
-    {
-        if (Root && depth <= ONE_PLY)
-            cnt = 1, nodes++;
-        else
-        {
-            pos.do_move(m, st);
-            cnt = leaf ? MoveList<LEGAL>(pos).size() : perft<false>(pos, depth - ONE_PLY);
-            nodes += cnt;
-            pos.undo_move(m);
-        }
-        if (Root)
-            sync_cout << UCI::move(m) << ": " << cnt << sync_endl;
-    }
-    return nodes;
-  }
+  void update_tt_stats(Thread* thisThread, const TTEntry* tte);
 
 } // namespace
 
@@ -219,6 +256,8 @@ void Search::clear() {
 
   Threads.main()->callsCnt = 0;
   Threads.main()->previousScore = VALUE_INFINITE;
+  Threads.main()->bestMove = MOVE_NONE;
+  Threads.main()->failedLow = false;
 }
 
 
@@ -229,14 +268,33 @@ void MainThread::search() {
 
   if (Limits.perft)
   {
-      nodes = perft<true>(rootPos, Limits.perft * ONE_PLY);
-      sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+      Perft::start(rootPos, Limits.perft * ONE_PLY);
+
+      for (Thread* th : Threads)
+          if (th != this)
+              th->start_searching();
+
+      Perft::search(rootPos);
+
+      for (Thread* th : Threads)
+          if (th != this)
+              th->wait_for_search_finished();
+
+      nodes = Perft::finish(Limits.divide);
+      TimePoint elapsed = now() - Limits.startTime + 1; // Avoid a zero division
+
+      sync_cout << "\nNodes searched: " << nodes
+                << "\nNodes/second  : " << 1000 * nodes / elapsed << "\n" << sync_endl;
       return;
   }
 
   Color us = rootPos.side_to_move();
   Time.init(Limits, us, rootPos.game_ply());
   TT.new_search();
+  Cooperative = Options["Cooperative Search"] && Threads.size() > 1;
+
+  for (Thread* th : Threads)
+      th->history = Options["Shared History"] ? &Threads.main()->ownHistory : &th->ownHistory;
 
   int contempt = Options["Contempt"] * PawnValueEg / 100; // From centipawns
   DrawValue[ us] = VALUE_DRAW - Value(contempt);
@@ -264,9 +322,7 @@ void MainThread::search() {
   // GUI sends a "stop" or "ponderhit" command. We therefore simply wait here
   // until the GUI sends one of those commands (which also raises Threads.stop).
   Threads.stopOnPonderhit = true;
-
-  while (!Threads.stop && (Threads.ponder || Limits.infinite))
-  {} // Busy wait for a stop or a ponder reset
+  Threads.wait_for_stop();
 
   // Stop the threads if not already stopped (also raise the stop if
   // "ponderhit" just reset Threads.ponder).
@@ -290,24 +346,72 @@ void MainThread::search() {
       && !Skill(Options["Skill Level"]).enabled()
       &&  rootMoves[0].pv[0] != MOVE_NONE)
   {
+      // Each thread votes for its best move, with a weight growing with its
+      // completed depth and with its score above the lowest one of all threads.
+      // Threads that have not completed an iteration don't vote.
+      std::map<Move, int64_t> votes;
+      Value minScore = VALUE_INFINITE;
+
+      for (Thread* th : Threads)
+          if (th->completedDepth)
+              minScore = std::min(minScore, th->rootMoves[0].score);
+
+      for (Thread* th : Threads)
+          if (th->completedDepth)
+              votes[th->rootMoves[0].pv[0]] +=  (th->rootMoves[0].score - minScore + 14)
+                                              * int(th->completedDepth);
+
+      // Send the tallies, most voted moves first
+      if (Threads.size() > 1)
+      {
+          std::vector<std::pair<int64_t, Move>> tally;
+          for (auto& v : votes)
+              tally.emplace_back(v.second, v.first);
+
+          std::sort(tally.rbegin(), tally.rend());
+
+          std::stringstream ss;
+          for (auto& t : tally)
+              ss << " " << UCI::move(t.second) << " " << t.first << " ("
+                 << std::count_if(Threads.begin(), Threads.end(), [&](Thread* th) {
+                        return th->completedDepth && th->rootMoves[0].pv[0] == t.second; })
+                 << " threads)";
+
+          sync_cout << "info string votes" << ss.str() << sync_endl;
+      }
+
+      // Select a thread of the most voted move, the deepest one among them,
+      // except that the shortest mate found is always preferred.
       for (Thread* th : Threads)
       {
-          Depth depthDiff = th->completedDepth - bestThread->completedDepth;
-          Value scoreDiff = th->rootMoves[0].score - bestThread->rootMoves[0].score;
+          if (!th->completedDepth)
+              continue;
 
-          // Select the thread with the best score, always if it is a mate
-          if (    scoreDiff > 0
-              && (depthDiff >= 0 || th->rootMoves[0].score >= VALUE_MATE_IN_MAX_PLY))
+          Value score = th->rootMoves[0].score, bestScore = bestThread->rootMoves[0].score;
+          Move m = th->rootMoves[0].pv[0], best = bestThread->rootMoves[0].pv[0];
+
+          if (bestScore >= VALUE_MATE_IN_MAX_PLY || score >= VALUE_MATE_IN_MAX_PLY)
+          {
+              if (score > bestScore)
+                  bestThread = th;
+          }
+          else if (   votes[m] > votes[best]
+                   || (m == best && th->completedDepth > bestThread->completedDepth))
               bestThread = th;
       }
   }
 
   previousScore = bestThread->rootMoves[0].score;
+  bestMove = bestThread->rootMoves[0].pv[0];
 
   // Send new PV when needed
   if (bestThread != this)
       sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
 
+  // In cluster mode a worker process may have found a better move
+  if (Cluster::send_best(rootPos, bestThread->rootMoves[0], bestThread->completedDepth))
+      return;
+
   sync_cout << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0]);
 
   if (bestThread->rootMoves[0].pv.size() > 1 || bestThread->rootMoves[0].extract_ponder_from_tt(rootPos))
@@ -323,6 +427,12 @@ void MainThread::search() {
 
 void Thread::search() {
 
+  if (Limits.perft)
+  {
+      Perft::search(rootPos);
+      return;
+  }
+
   Stack stack[MAX_PLY+7], *ss = stack+4; // To reference from (ss-4) to (ss+2)
   Value bestValue, alpha, beta, delta;
   Move easyMove = MOVE_NONE;
@@ -330,7 +440,7 @@ void Thread::search() {
 
   std::memset(ss-4, 0, 7 * sizeof(Stack));
   for (int i = 4; i > 0; i--)
-     (ss-i)->contHistory = &this->contHistory[NO_PIECE][0]; // Use as sentinel
+     (ss-i)->contHistory = &history->contHistory[NO_PIECE][0]; // Use as sentinel
 
   bestValue = delta = alpha = -VALUE_INFINITE;
   beta = VALUE_INFINITE;
@@ -534,7 +644,7 @@ namespace {
     assert(!(PvNode && cutNode));
     assert(depth / ONE_PLY * ONE_PLY == depth);
 
-    Move pv[MAX_PLY+1], quietsSearched[64];
+    Move pv[MAX_PLY+1], quietsSearched[64], deferred[MaxDeferred];
     StateInfo st;
     TTEntry* tte;
     Key posKey;
@@ -544,7 +654,7 @@ namespace {
     bool ttHit, inCheck, givesCheck, singularExtensionNode, improving;
     bool captureOrPromotion, doFullDepthSearch, moveCountPruning, skipQuiets, ttCapture, pvExact;
     Piece movedPiece;
-    int moveCount, quietCount;
+    int moveCount, quietCount, deferredCount, deferredIdx, deferredMoveCount[MaxDeferred];
 
     // Step 1. Initialize node
     Thread* thisThread = pos.this_thread();
@@ -584,7 +694,7 @@ namespace {
 
     (ss+1)->ply = ss->ply + 1;
     ss->currentMove = (ss+1)->excludedMove = bestMove = MOVE_NONE;
-    ss->contHistory = &thisThread->contHistory[NO_PIECE][0];
+    ss->contHistory = &thisThread->history->contHistory[NO_PIECE][0];
     (ss+2)->killers[0] = (ss+2)->killers[1] = MOVE_NONE;
     Square prevSq = to_sq((ss-1)->currentMove);
 
@@ -593,11 +703,18 @@ namespace {
     // position key in case of an excluded move.
     excludedMove = ss->excludedMove;
     posKey = pos.key() ^ Key(excludedMove);
-    tte = TT.probe(posKey, ttHit);
+    tte = TT.probe(posKey, ttHit, thisThread);
+    if (!ttHit)
+        update_tt_stats(thisThread, tte);
+    thisThread->stats.inc(SearchStats::TTProbes);
+    thisThread->stats.inc(SearchStats::TTHits, ttHit);
     ttValue = ttHit ? value_from_tt(tte->value(), ss->ply) : VALUE_NONE;
     ttMove =  rootNode ? thisThread->rootMoves[thisThread->PVIdx].pv[0]
             : ttHit    ? tte->move() : MOVE_NONE;
 
+    // Let the other threads know we are searching this node
+    ThreadHolding th(thisThread, posKey, depth, Cooperative && ss->ply < CoopMaxPly);
+
     // At non-PV nodes we check for an early TT cutoff
     if (  !PvNode
         && ttHit
@@ -622,7 +739,7 @@ namespace {
             else if (!pos.capture_or_promotion(ttMove))
             {
                 int penalty = -stat_bonus(depth);
-                thisThread->mainHistory.update(pos.side_to_move(), ttMove, penalty);
+                thisThread->history->mainHistory.update(pos.side_to_move(), ttMove, penalty);
                 update_continuation_histories(ss, pos.moved_piece(ttMove), to_sq(ttMove), penalty);
             }
         }
@@ -726,7 +843,9 @@ namespace {
         Depth R = ((823 + 67 * depth / ONE_PLY) / 256 + std::min((eval - beta) / PawnValueMg, 3)) * ONE_PLY;
 
         ss->currentMove = MOVE_NULL;
-        ss->contHistory = &thisThread->contHistory[NO_PIECE][0];
+        ss->contHistory = &thisThread->history->contHistory[NO_PIECE][0];
+
+        thisThread->stats.inc(SearchStats::NullMoveTries);
 
         pos.do_null_move(st);
         Value nullValue = depth-R < ONE_PLY ? -qsearch<NonPV, false>(pos, ss+1, -beta, -beta+1)
@@ -735,6 +854,8 @@ namespace {
 
         if (nullValue >= beta)
         {
+            thisThread->stats.inc(SearchStats::NullMoveCutoffs);
+
             // Do not return unproven mate scores
             if (nullValue >= VALUE_MATE_IN_MAX_PLY)
                 nullValue = beta;
@@ -768,7 +889,7 @@ namespace {
             if (pos.legal(move))
             {
                 ss->currentMove = move;
-                ss->contHistory = &thisThread->contHistory[pos.moved_piece(move)][to_sq(move)];
+                ss->contHistory = &thisThread->history->contHistory[pos.moved_piece(move)][to_sq(move)];
 
                 assert(depth >= 5 * ONE_PLY);
                 pos.do_move(move, st);
@@ -787,16 +908,16 @@ namespace {
         Depth d = (3 * depth / (4 * ONE_PLY) - 2) * ONE_PLY;
         search<NT>(pos, ss, alpha, beta, d, cutNode, true);
 
-        tte = TT.probe(posKey, ttHit);
+        tte = TT.probe(posKey, ttHit, thisThread);
         ttMove = ttHit ? tte->move() : MOVE_NONE;
     }
 
 moves_loop: // When in check search starts from here
 
     const PieceToHistory* contHist[] = { (ss-1)->contHistory, (ss-2)->contHistory, nullptr, (ss-4)->contHistory };
-    Move countermove = thisThread->counterMoves[pos.piece_on(prevSq)][prevSq];
+    Move countermove = thisThread->history->counterMoves[pos.piece_on(prevSq)][prevSq];
 
-    MovePicker mp(pos, ttMove, depth, &thisThread->mainHistory, contHist, countermove, ss->killers);
+    MovePicker mp(pos, ttMove, depth, &thisThread->history->mainHistory, contHist, countermove, ss->killers);
     value = bestValue; // Workaround a bogus 'uninitialized' warning under gcc
     improving =   ss->staticEval >= (ss-2)->staticEval
             /* || ss->staticEval == VALUE_NONE Already implicit in the previous condition */
@@ -812,10 +933,13 @@ moves_loop: // When in check search starts from here
     skipQuiets = false;
     ttCapture = false;
     pvExact = PvNode && ttHit && tte->bound() == BOUND_EXACT;
+    deferredCount = deferredIdx = 0;
 
     // Step 11. Loop through moves
-    // Loop through all pseudo-legal moves until no moves remain or a beta cutoff occurs
-    while ((move = mp.next_move(skipQuiets)) != MOVE_NONE)
+    // Loop through all pseudo-legal moves until no moves remain or a beta cutoff occurs,
+    // then through the moves deferred by the cooperative search.
+    while (   (move = mp.next_move(skipQuiets)) != MOVE_NONE
+           || (deferredIdx < deferredCount && (move = deferred[deferredIdx++]) != MOVE_NONE))
     {
       assert(is_ok(move));
 
@@ -829,7 +953,7 @@ moves_loop: // When in check search starts from here
                                   thisThread->rootMoves.end(), move))
           continue;
 
-      ss->moveCount = ++moveCount;
+      ss->moveCount = moveCount = deferredIdx ? deferredMoveCount[deferredIdx - 1] : moveCount + 1;
 
       if (rootNode && thisThread == Threads.main() && Time.elapsed() > 3000)
           sync_cout << "info depth " << depth / ONE_PLY
@@ -930,12 +1054,27 @@ moves_loop: // When in check search starts from here
           continue;
       }
 
+      // Defer the move if another thread is searching the node it leads to
+      if (    Cooperative
+          && !rootNode
+          &&  moveCount > 1
+          && !deferredIdx
+          &&  deferredCount < MaxDeferred
+          &&  ss->ply + 1 < CoopMaxPly
+          &&  searched_by_other(thisThread, pos.key_after(move), newDepth))
+      {
+          deferredMoveCount[deferredCount] = moveCount;
+          deferred[deferredCount++] = move;
+          ss->moveCount = --moveCount;
+          continue;
+      }
+
       if (move == ttMove && captureOrPromotion)
           ttCapture = true;
 
       // Update the current move (this must be done after singular extension search)
       ss->currentMove = move;
-      ss->contHistory = &thisThread->contHistory[movedPiece][to_sq(move)];
+      ss->contHistory = &thisThread->history->contHistory[movedPiece][to_sq(move)];
 
       // Step 14. Make the move
       pos.do_move(move, st, givesCheck);
@@ -972,7 +1111,7 @@ moves_loop: // When in check search starts from here
               else if (!pos.see_ge(make_move(to_sq(move), from_sq(move))))
                   r -= 2 * ONE_PLY;
 
-              ss->statScore =  thisThread->mainHistory[~pos.side_to_move()][from_to(move)]
+              ss->statScore =  thisThread->history->mainHistory[~pos.side_to_move()][from_to(move)]
                              + (*contHist[0])[movedPiece][to_sq(move)]
                              + (*contHist[1])[movedPiece][to_sq(move)]
                              + (*contHist[3])[movedPiece][to_sq(move)]
@@ -994,6 +1133,8 @@ moves_loop: // When in check search starts from here
           value = -search<NonPV>(pos, ss+1, -(alpha+1), -alpha, d, true, false);
 
           doFullDepthSearch = (value > alpha && d != newDepth);
+          thisThread->stats.inc(SearchStats::LmrSearches);
+          thisThread->stats.inc(SearchStats::LmrResearches, doFullDepthSearch);
       }
       else
           doFullDepthSearch = !PvNode || moveCount > 1;
@@ -1077,6 +1218,8 @@ moves_loop: // When in check search starts from here
               else
               {
                   assert(value >= beta); // Fail high
+                  thisThread->stats.inc(SearchStats::BetaCutoffs);
+                  thisThread->stats.inc(SearchStats::FirstMoveCutoffs, moveCount == 1);
                   break;
               }
           }
@@ -1086,6 +1229,12 @@ moves_loop: // When in check search starts from here
           quietsSearched[quietCount++] = move;
     }
 
+    if (!inCheck)
+    {
+        thisThread->stats.inc(SearchStats::PickerLoops);
+        thisThread->stats.inc(SearchStats::PickerStages, mp.stage_reached());
+    }
+
     // The following condition would detect a stop only after move loop has been
     // completed. But in this case bestValue is valid because we have fully
     // searched our subtree, and we can anyhow save the result in TT.
@@ -1182,7 +1331,12 @@ moves_loop: // When in check search starts from here
                                                   : DEPTH_QS_NO_CHECKS;
     // Transposition table lookup
     posKey = pos.key();
-    tte = TT.probe(posKey, ttHit);
+    tte = TT.probe(posKey, ttHit, pos.this_thread());
+    if (!ttHit)
+        update_tt_stats(pos.this_thread(), tte);
+    pos.this_thread()->stats.inc(SearchStats::QSearchNodes);
+    pos.this_thread()->stats.inc(SearchStats::TTProbes);
+    pos.this_thread()->stats.inc(SearchStats::TTHits, ttHit);
     ttMove = ttHit ? tte->move() : MOVE_NONE;
     ttValue = ttHit ? value_from_tt(tte->value(), ss->ply) : VALUE_NONE;
 
@@ -1238,7 +1392,7 @@ moves_loop: // When in check search starts from here
     // to search the moves. Because the depth is <= 0 here, only captures,
     // queen promotions and checks (only if depth >= DEPTH_QS_CHECKS) will
     // be generated.
-    MovePicker mp(pos, ttMove, depth, &pos.this_thread()->mainHistory, to_sq((ss-1)->currentMove));
+    MovePicker mp(pos, ttMove, depth, &pos.this_thread()->history->mainHistory, to_sq((ss-1)->currentMove));
 
     // Loop through the moves until no moves remain or a beta cutoff occurs
     while ((move = mp.next_move()) != MOVE_NONE)
@@ -1404,24 +1558,36 @@ moves_loop: // When in check search starts from here
 
     Color c = pos.side_to_move();
     Thread* thisThread = pos.this_thread();
-    thisThread->mainHistory.update(c, move, bonus);
+    thisThread->history->mainHistory.update(c, move, bonus);
     update_continuation_histories(ss, pos.moved_piece(move), to_sq(move), bonus);
 
     if (is_ok((ss-1)->currentMove))
     {
         Square prevSq = to_sq((ss-1)->currentMove);
-        thisThread->counterMoves[pos.piece_on(prevSq)][prevSq] = move;
+        thisThread->history->counterMoves[pos.piece_on(prevSq)][prevSq] = move;
     }
 
     // Decrease all the other played quiet moves
     for (int i = 0; i < quietsCnt; ++i)
     {
-        thisThread->mainHistory.update(c, quiets[i], -bonus);
+        thisThread->history->mainHistory.update(c, quiets[i], -bonus);
         update_continuation_histories(ss, pos.moved_piece(quiets[i]), to_sq(quiets[i]), -bonus);
     }
   }
 
 
+  // update_tt_stats() is called on a TT miss, when the returned entry is going
+  // to be replaced. Entries written by the current search are counted apart as
+  // overwrites: when they are frequent the table is too small for the search.
+
+  void update_tt_stats(Thread* thisThread, const TTEntry* tte) {
+
+    if (!tte->empty())
+        (tte->generation() == TT.generation() ? thisThread->ttOverwrites
+                                              : thisThread->ttReplacements).fetch_add(1, std::memory_order_relaxed);
+  }
+
+
   // When playing with strength handicap, choose best move among a set of RootMoves
   // using a statistical rule dependent on 'level'. Idea by Heinz van Saanen.
 
@@ -1563,7 +1729,7 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
         return false;
 
     pos.do_move(pv[0], st);
-    TTEntry* tte = TT.probe(pos.key(), ttHit);
+    TTEntry* tte = TT.probe(pos.key(), ttHit, pos.this_thread());
 
     if (ttHit)
     {
@@ -82,7 +82,7 @@ struct LimitsType {
 
   LimitsType() { // Init explicitly due to broken value-initialization of non POD in MSVC
     nodes = time[WHITE] = time[BLACK] = inc[WHITE] = inc[BLACK] =
-    npmsec = movestogo = depth = movetime = mate = perft = infinite = 0;
+    npmsec = movestogo = depth = movetime = mate = perft = divide = infinite = 0;
   }
 
   bool use_time_management() const {
@@ -91,7 +91,7 @@ struct LimitsType {
 
   std::vector<Move> searchmoves;
   int time[COLOR_NB], inc[COLOR_NB], npmsec, movestogo, depth,
-      movetime, mate, perft, infinite;
+      movetime, mate, perft, divide, infinite;
   int64_t nodes;
   TimePoint startTime;
 };
@@ -21,6 +21,7 @@
 #include <algorithm> // For std::count
 #include <cassert>
 
+#include "cluster.h"
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
@@ -35,7 +36,6 @@ ThreadPool Threads; // Global object
 Thread::Thread(size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
 
   wait_for_search_finished();
-  clear(); // Zero-init histories (based on std::array)
 }
 
 
@@ -52,9 +52,9 @@ Thread::~Thread() {
 }
 
 
-/// Thread::clear() reset histories, usually before a new game
+/// HistoryTables::clear() resets the statistics, usually before a new game
 
-void Thread::clear() {
+void HistoryTables::clear() {
 
   counterMoves.fill(MOVE_NONE);
   mainHistory.fill(0);
@@ -66,6 +66,15 @@ void Thread::clear() {
   contHistory[NO_PIECE][0].fill(Search::CounterMovePruneThreshold - 1);
 }
 
+
+/// Thread::clear() reset histories, usually before a new game
+
+void Thread::clear() {
+
+  ownHistory.clear();
+}
+
+
 /// Thread::start_searching() wakes up the thread that will start the search
 
 void Thread::start_searching() {
@@ -82,7 +91,29 @@ void Thread::start_searching() {
 void Thread::wait_for_search_finished() {
 
   std::unique_lock<Mutex> lk(mutex);
-  cv.wait(lk, [&]{ return !searching; });
+  wait_until(lk, false);
+}
+
+
+/// Thread::wait_until() blocks until 'searching' gets the given value. With a
+/// "Spin Wait" budget it first polls the flag for up to that many microseconds,
+/// yielding the CPU in between, and only then parks on the condition variable.
+/// A thread that is still spinning when woken up skips the handoff through the
+/// scheduler, which matters at very fast time controls with many threads.
+
+void Thread::wait_until(std::unique_lock<Mutex>& lk, bool state) {
+
+  if (int budget = Threads.spinWait)
+  {
+      auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(budget);
+
+      lk.unlock();
+      while (searching != state && std::chrono::steady_clock::now() < end)
+          std::this_thread::yield();
+      lk.lock();
+  }
+
+  cv.wait(lk, [&]{ return searching == state; });
 }
 
 
@@ -91,19 +122,30 @@ void Thread::wait_for_search_finished() {
 
 void Thread::idle_loop() {
 
+  // Bind the thread before it writes its tables for the first time, so that on
+  // NUMA hardware their memory is allocated on the node it runs on. The pawn
+  // and material tables, already zeroed by the constructor, are made anew.
   WinProcGroup::bindThisThread(idx);
 
+  pawnsTable = Pawns::Table();
+  materialTable = Material::Table();
+  clear(); // Zero-init histories (based on std::array)
+
   while (true)
   {
       std::unique_lock<Mutex> lk(mutex);
       searching = false;
       cv.notify_one(); // Wake up anyone waiting for search finished
-      cv.wait(lk, [&]{ return searching; });
+      wait_until(lk, true);
 
       if (exit)
           return;
 
       lk.unlock();
+      wakeTime = std::chrono::steady_clock::now();
+
+      rootPos.set(Threads.rootPos, this);
+      rootMoves = Threads.rootMoves;
 
       search();
   }
@@ -145,6 +187,24 @@ void ThreadPool::set(size_t requested) {
 }
 
 
+/// ThreadPool::wait_for_stop() is called by the main thread when its search is
+/// over but it's not allowed to return a best move yet, because it's pondering
+/// or in an infinite search. It sleeps until the UCI thread raises 'stop' or
+/// resets 'ponder', and then calls wake_up().
+
+void ThreadPool::wait_for_stop() {
+
+  std::unique_lock<Mutex> lk(mutex);
+  sleepCondition.wait(lk, [&]{ return stop || !(ponder || Search::Limits.infinite); });
+}
+
+void ThreadPool::wake_up() {
+
+  std::lock_guard<Mutex> lk(mutex);
+  sleepCondition.notify_one();
+}
+
+
 /// ThreadPool::start_thinking() wakes up main thread waiting in idle_loop() and
 /// returns immediately. Main thread will wake up other threads and start the search.
 
@@ -156,7 +216,7 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   stopOnPonderhit = stop = false;
   ponder = ponderMode;
   Search::Limits = limits;
-  Search::RootMoves rootMoves;
+  rootMoves.clear();
 
   for (const auto& m : MoveList<LEGAL>(pos))
       if (   limits.searchmoves.empty()
@@ -166,6 +226,8 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   if (!rootMoves.empty())
       Tablebases::filter_root_moves(pos, rootMoves);
 
+  Cluster::split(limits, rootMoves);
+
   // After ownership transfer 'states' becomes empty, so if we stop the search
   // and call 'go' again without setting a new position states.get() == NULL.
   assert(states.get() || setupStates.get());
@@ -173,22 +235,19 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   if (states.get())
       setupStates = std::move(states); // Ownership transfer, states is now empty
 
-  // We use Position::set() to set root position across threads. But there are
-  // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
-  // be deduced from a fen string, so set() clears them and to not lose the info
-  // we need to backup and later restore setupStates->back(). Note that setupStates
-  // is shared by threads but is accessed in read-only mode.
-  StateInfo tmp = setupStates->back();
+  // Each thread copies rootPos and rootMoves when it wakes up in idle_loop(), so
+  // that with many threads this is done in parallel. The copies share the root
+  // StateInfo, setupStates->back(), that is accessed in read-only mode. Only the
+  // counters read by the main thread while searching are reset here.
+  rootPos.set(pos, nullptr);
 
   for (Thread* th : Threads)
   {
-      th->nodes = th->tbHits = 0;
+      th->nodes = th->tbHits = th->ttFalseHits = th->ttTorn = 0;
+      th->ttReplacements = th->ttOverwrites = 0;
+      th->stats.clear();
       th->rootDepth = th->completedDepth = DEPTH_ZERO;
-      th->rootMoves = rootMoves;
-      th->rootPos.set(pos.fen(), pos.is_chess960(), &setupStates->back(), th);
   }
 
-  setupStates->back() = tmp;
-
   main()->start_searching();
 }
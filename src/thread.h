@@ -22,6 +22,7 @@
 #define THREAD_H_INCLUDED
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
@@ -35,6 +36,56 @@
 #include "thread_win32.h"
 
 
+/// SearchStats counts how often some events happen on the hot paths of the
+/// search of a thread, to measure the efficiency of the search with the "stats"
+/// command. Counters exist only when built with stats=yes (SEARCH_STATS), else
+/// inc() is empty and the counting is compiled out.
+
+struct SearchStats {
+
+  enum Counter {
+    TTProbes, TTHits, QSearchNodes, BetaCutoffs, FirstMoveCutoffs,
+    NullMoveTries, NullMoveCutoffs, LmrSearches, LmrResearches,
+    PickerLoops, PickerStages, COUNTER_NB
+  };
+
+#ifdef SEARCH_STATS
+  static const bool Enabled = true;
+
+  void inc(Counter c, uint64_t n = 1) { // Only the owner thread writes
+    counters[c].store(counters[c].load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+  }
+  uint64_t operator[](Counter c) const { return counters[c].load(std::memory_order_relaxed); }
+  void clear() { for (auto& c : counters) c = 0; }
+
+private:
+  std::atomic<uint64_t> counters[COUNTER_NB];
+#else
+  static const bool Enabled = false;
+
+  void inc(Counter, uint64_t = 1) {}
+  uint64_t operator[](Counter) const { return 0; }
+  void clear() {}
+#endif
+};
+
+
+/// HistoryTables keeps together the move ordering statistics of a thread. With
+/// "Shared History" all the threads update those of the main thread instead of
+/// learning the same things each on its own. The entries are then updated with
+/// relaxed atomics, see Relaxed: an update may be lost, which is harmless, but
+/// an entry always stays in range.
+
+struct HistoryTables {
+
+  void clear();
+
+  CounterMoveHistory counterMoves;
+  ButterflyHistory mainHistory;
+  ContinuationHistory contHistory;
+};
+
+
 /// Thread class keeps together all the thread-related stuff. We use
 /// per-thread pawn and material hash tables so that once we get a
 /// pointer to an entry its life time is unlimited and we don't have
@@ -45,8 +96,10 @@ class Thread {
   Mutex mutex;
   ConditionVariable cv;
   size_t idx;
-  bool exit = false, searching = true; // Set before starting std::thread
-  std::thread stdThread;
+  bool exit = false;
+  std::atomic_bool searching { true }; // Set before starting std::thread
+
+  void wait_until(std::unique_lock<Mutex>&, bool);
 
 public:
   explicit Thread(size_t);
@@ -62,14 +115,18 @@ public:
   Endgames endgames;
   size_t PVIdx;
   int selDepth;
-  std::atomic<uint64_t> nodes, tbHits;
+  std::atomic<uint64_t> nodes, tbHits, ttFalseHits, ttTorn, ttReplacements, ttOverwrites;
+  SearchStats stats;
+  std::chrono::steady_clock::time_point wakeTime; // Last time woken up to search
 
   Position rootPos;
   Search::RootMoves rootMoves;
   Depth rootDepth, completedDepth;
-  CounterMoveHistory counterMoves;
-  ButterflyHistory mainHistory;
-  ContinuationHistory contHistory;
+  HistoryTables* history = &ownHistory; // Own tables or those of the main thread
+  HistoryTables ownHistory;
+
+private:
+  std::thread stdThread; // Last, idle_loop() initializes the members above
 };
 
 
@@ -85,6 +142,7 @@ struct MainThread : public Thread {
   bool easyMovePlayed, failedLow;
   double bestMoveChanges;
   Value previousScore;
+  Move bestMove; // Last one sent to the GUI, with previousScore
   int callsCnt;
 };
 
@@ -99,15 +157,35 @@ struct ThreadPool : public std::vector<Thread*> {
   void exit();       // be initialized and valid during the whole thread lifetime.
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
   void set(size_t);
+  void wait_for_stop();
+  void wake_up();
 
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
   uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
   uint64_t tb_hits()        const { return accumulate(&Thread::tbHits); }
+  uint64_t tt_false_hits()  const { return accumulate(&Thread::ttFalseHits); }
+  uint64_t tt_torn()        const { return accumulate(&Thread::ttTorn); }
+  uint64_t tt_replacements() const { return accumulate(&Thread::ttReplacements); }
+  uint64_t tt_overwrites()  const { return accumulate(&Thread::ttOverwrites); }
+  uint64_t search_stats(SearchStats::Counter c) const {
+
+    uint64_t sum = 0;
+    for (Thread* th : *this)
+        sum += th->stats[c];
+    return sum;
+  }
 
   std::atomic_bool stop, ponder, stopOnPonderhit;
+  std::atomic_int spinWait; // In microseconds, see Thread::wait_until()
+
+  // Copied by each thread when it wakes up to search, see start_thinking()
+  Position rootPos;
+  Search::RootMoves rootMoves;
 
 private:
   StateListPtr setupStates;
+  Mutex mutex;
+  ConditionVariable sleepCondition;
 
   uint64_t accumulate(std::atomic<uint64_t> Thread::* member) const {
 
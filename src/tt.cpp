@@ -18,49 +18,425 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
-#include <cstring>   // For std::memset
+#ifndef _WIN32
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>    // For std::rename
+#include <cstring>   // For std::memset, std::memcmp
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
+#include <thread>
+#include <vector>
 
 #include "bitboard.h"
+#include "thread.h"
 #include "tt.h"
+#include "uci.h"
 
 TranspositionTable TT; // Our global transposition table
 
+const std::vector<std::string> TranspositionTable::PolicyNames = {
+  "Depth-Age", "Oldest", "Two-Tier", "Bound-Aware"
+};
+
+/// TTFileHeader is written in front of the clusters by TranspositionTable::save()
+/// and in shared memory segments. It records the table layout, so that tables
+/// from an incompatible build are refused. Its size keeps the clusters cache
+/// line aligned once the file or segment is mapped at a page boundary.
+
+struct TTFileHeader {
+  char magic[8];
+  uint64_t clusterCount;
+  uint32_t clusterSize, entrySize, clusterBytes, generation, checksumBits;
+  char reserved[28];
+};
+
+static_assert(sizeof(TTFileHeader) == 64, "TTFileHeader size incorrect");
+
+namespace {
+
+  const char TTFileMagic[8] = "SFTT001";
+
+  // for_each_slice() splits the range [0, count) in one slice per search thread
+  // and calls f(start, len) on every slice from a separate std::thread, bound by
+  // WinProcGroup::bindThisThread() as the search thread with the same index.
+  template<typename F>
+  void for_each_slice(size_t count, F f) {
+
+    const size_t n = std::max(Threads.size(), size_t(1));
+    std::vector<std::thread> threads;
+
+    for (size_t idx = 0; idx < n; ++idx)
+        threads.emplace_back([=]() {
+
+            WinProcGroup::bindThisThread(idx);
+
+            const size_t stride = count / n, start = stride * idx;
+            f(start, idx == n - 1 ? count - start : stride);
+        });
+
+    for (std::thread& th : threads)
+        th.join();
+  }
+
+} // namespace
+
 
 /// TranspositionTable::resize() sets the size of the transposition table,
 /// measured in megabytes. Transposition table consists of a power of 2 number
-/// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// of clusters and each cluster consists of ClusterSize number of TTEntry. The
+/// table is reallocated also when the "Large Pages" or "Shared Hash" options
+/// are changed. The content of the old table is carried over to a new private
+/// one, see rehash().
 
 void TranspositionTable::resize(size_t mbSize) {
 
   size_t newClusterCount = size_t(1) << msb((mbSize * 1024 * 1024) / sizeof(Cluster));
+  bool useLargePages = Options["Large Pages"];
+  std::string newSharedName = Options["Shared Hash"];
+
+  if (newSharedName == "<empty>")
+      newSharedName.clear();
 
-  if (newClusterCount == clusterCount)
+  if (   newClusterCount == clusterCount
+      && useLargePages == largePages
+      && newSharedName == sharedName)
       return;
 
+  void* oldMem = mem;
+  const Cluster* oldTable = table;
+  size_t oldCount = clusterCount;
+  MemoryBacking oldBacking = backing;
+
+  generation8 = generation(); // Carried over from a shared table
+
   clusterCount = newClusterCount;
+  largePages = useLargePages;
+  sharedName = newSharedName;
+
+  if (!sharedName.empty() && !attach_shared())
+  {
+      sync_cout << "info string Failed to attach shared hash " << sharedName
+                << ", using a private one" << sync_endl;
+      sharedName.clear();
+  }
+
+  if (sharedName.empty())
+  {
+      table = (Cluster*)(mem = aligned_large_alloc(clusterCount * sizeof(Cluster), largePages, backing));
+
+      if (!table)
+      {
+          std::cerr << "Failed to allocate " << mbSize
+                    << "MB for transposition table." << std::endl;
+          exit(EXIT_FAILURE);
+      }
+
+      if (oldTable)
+          rehash(oldTable, oldCount);
+      else
+          clear(); // Only memory from mmap() is guaranteed to be zeroed
+  }
+
+  release(oldMem, oldCount, oldBacking);
+
+  sync_cout << "info string Hash table of " << (clusterCount * sizeof(Cluster) >> 20)
+            << "MB on " << to_string(backing) << sync_endl;
+}
+
+
+/// TranspositionTable::rehash() fills the table with the entries of a table of
+/// another size. The index of a cluster is made of the lowest bits of the keys
+/// of its positions. When shrinking, each new cluster keeps the most valuable
+/// entries of the old clusters folding onto it. When growing, the index bits
+/// missing from the old one are not stored in the entries, so each old cluster
+/// is copied to all the new clusters it may map to. The copies in the wrong
+/// clusters can only cause false hits as any key collision, and are replaced
+/// as they age. The work is shared among the search threads as in clear().
+
+void TranspositionTable::rehash(const Cluster* old, size_t oldCount) {
+
+  const uint8_t gen = generation();
+
+  for_each_slice(clusterCount, [&](size_t start, size_t len) {
+
+      for (size_t i = start; i < start + len; ++i)
+      {
+          if (clusterCount >= oldCount)
+          {
+              table[i] = old[i & (oldCount - 1)];
+              continue;
+          }
+
+          std::memset(&table[i], 0, sizeof(Cluster));
+
+          TTEntry* const tte = table[i].entry;
+
+          for (size_t j = i; j < oldCount; j += clusterCount)
+              for (const TTEntry& e : old[j].entry)
+              {
+                  if (e.empty())
+                      continue;
+
+                  // Entries for the same position, as the copies made when
+                  // growing, are merged.
+                  TTEntry* replace = std::find_if(tte, tte + ClusterSize,
+                                                  [&](const TTEntry& t) { return t.key == e.key; });
+
+                  if (replace == tte + ClusterSize)
+                  {
+                      replace = tte;
+                      for (int k = 1; k < ClusterSize && !replace->empty(); ++k)
+                          if (tte[k].empty() || worth(*replace, gen) > worth(tte[k], gen))
+                              replace = &tte[k];
+                  }
+
+                  if (replace->empty() || worth(*replace, gen) < worth(e, gen))
+                      *replace = e;
+              }
+      }
+  });
+}
+
+
+/// TranspositionTable::attach_shared() maps the table from the POSIX shared
+/// memory segment named by the "Shared Hash" option, creating it if needed.
+/// Cooperating engine processes on the same host may then share one table:
+/// concurrent accesses from other processes are no different from the ones of
+/// our own threads, that are already tolerated by the lockless TTEntry design.
+/// The segment begins with a TTFileHeader; a process attaching to an existing
+/// segment waits for the creator to publish it, and then requires the same
+/// layout and size. The generation is kept in the header too, as new searches
+/// in any of the processes age the entries of all of them. The segment outlives
+/// the processes: it is removed only by deleting it, for instance from /dev/shm
+/// on Linux.
+
+bool TranspositionTable::attach_shared() {
+
+#ifndef _WIN32
+
+  const std::string name = sharedName[0] == '/' ? sharedName : "/" + sharedName;
+  const size_t size = sizeof(TTFileHeader) + clusterCount * sizeof(Cluster);
+  bool created = true;
+
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+  if (fd == -1 && errno == EEXIST)
+      created = false, fd = shm_open(name.c_str(), O_RDWR, 0600);
+
+  if (fd == -1)
+      return false;
+
+  if (created && ftruncate(fd, size) == -1)
+  {
+      close(fd);
+      shm_unlink(name.c_str());
+      return false;
+  }
+
+  // A segment just created by another process may not be sized yet
+  struct stat st;
+  for (int i = 0; !created && i < 100 && !fstat(fd, &st) && !st.st_size; ++i)
+      usleep(10000);
+
+  if (!created && (fstat(fd, &st) || size_t(st.st_size) != size))
+  {
+      close(fd);
+      return false;
+  }
+
+  void* m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (m == MAP_FAILED)
+      return false;
+
+  TTFileHeader* h = (TTFileHeader*)m;
+
+  if (created)
+      fill_header(*h); // New segments are zero-filled, so the table is clear
+  else
+  {
+      // The creator writes the magic last, so that a match means the header
+      // is complete. Give it some time in case we raced with it.
+      for (int i = 0; i < 100 && std::memcmp(h->magic, TTFileMagic, sizeof(h->magic)); ++i)
+          usleep(10000);
+
+      if (!check_header(*h) || h->clusterCount != clusterCount)
+      {
+          munmap(m, size);
+          return false;
+      }
+  }
+
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(h->generation), "Shared generation size incorrect");
+
+  mem = m;
+  backing = SHARED_MEMORY;
+  table = (Cluster*)((char*)mem + sizeof(TTFileHeader));
+  sharedGeneration = reinterpret_cast<std::atomic<uint32_t>*>(&h->generation);
+  return true;
+
+#else
+
+  return false;
+
+#endif
+}
+
+
+/// TranspositionTable::release() frees the table memory, however it was obtained
+
+void TranspositionTable::release(void* mem, size_t clusterCount, MemoryBacking backing) {
+
+#ifndef _WIN32
+  if (backing == MAPPED_FILE || backing == SHARED_MEMORY)
+  {
+      munmap(mem, sizeof(TTFileHeader) + clusterCount * sizeof(Cluster));
+      return;
+  }
+#endif
+
+  aligned_large_free(mem, clusterCount * sizeof(Cluster), backing);
+}
+
+
+/// TranspositionTable::fill_header() and check_header() write and verify the
+/// description of the table layout and size stored in a TTFileHeader.
+
+void TranspositionTable::fill_header(TTFileHeader& h) const {
+
+  std::memset(&h, 0, sizeof(h));
+  h.clusterCount = clusterCount;
+  h.clusterSize  = ClusterSize;
+  h.entrySize    = sizeof(TTEntry);
+  h.clusterBytes = sizeof(Cluster);
+  h.generation   = generation();
+  h.checksumBits = TTEntry::CheckBits;
+  std::memcpy(h.magic, TTFileMagic, sizeof(h.magic)); // Last, see attach_shared()
+}
+
+bool TranspositionTable::check_header(const TTFileHeader& h) const {
+
+  return  !std::memcmp(h.magic, TTFileMagic, sizeof(h.magic))
+        && h.clusterSize  == ClusterSize
+        && h.entrySize    == sizeof(TTEntry)
+        && h.clusterBytes == sizeof(Cluster)
+        && h.checksumBits == TTEntry::CheckBits
+        && h.clusterCount
+        && !(h.clusterCount & (h.clusterCount - 1));
+}
+
+
+/// TranspositionTable::save() dumps the table, preceded by a TTFileHeader, to
+/// the given file. We write to a temporary file and rename it at the end, so
+/// that a table mapped from the same file is never truncated under our feet.
+
+bool TranspositionTable::save(const std::string& fname) const {
+
+  TTFileHeader h;
+  fill_header(h);
+
+  const std::string tmpName = fname + ".tmp";
+  std::ofstream file(tmpName, std::ios::binary);
+
+  file.write((const char*)&h, sizeof(h));
+  file.write((const char*)table, clusterCount * sizeof(Cluster));
+  file.close();
+
+  return file && !std::rename(tmpName.c_str(), fname.c_str());
+}
+
 
-  free(mem);
-  mem = calloc(clusterCount * sizeof(Cluster) + CacheLineSize - 1, 1);
+/// TranspositionTable::load() replaces the table with the content of a file
+/// written by save(). Where available the file is mapped copy-on-write, so that
+/// loading is immediate and clusters are paged in as the search touches them.
+/// The table then keeps the size recorded in the file, whatever the "Hash"
+/// option says, until the next resize, and is no longer attached to a shared
+/// memory segment. It survives a clear() before the first search, as the
+/// "ucinewgame" that GUIs send before starting a game.
 
-  if (!mem)
+bool TranspositionTable::load(const std::string& fname) {
+
+  TTFileHeader h;
+  std::ifstream file(fname, std::ios::binary | std::ios::ate);
+  const size_t fileSize = size_t(file.tellg());
+
+  if (   !file.seekg(0).read((char*)&h, sizeof(h))
+      || !check_header(h)
+      ||  fileSize != sizeof(h) + h.clusterCount * sizeof(Cluster))
+      return false;
+
+#ifndef _WIN32
+
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd == -1)
+      return false;
+
+  void* m = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (m == MAP_FAILED)
+      return false;
+
+  release(mem, clusterCount, backing);
+  sharedName.clear();
+
+  mem = m;
+  backing = MAPPED_FILE;
+  table = (Cluster*)((char*)mem + sizeof(h));
+
+#else
+
+  MemoryBacking b;
+  void* m = aligned_large_alloc(h.clusterCount * sizeof(Cluster), largePages, b);
+
+  if (!m || !file.read((char*)m, h.clusterCount * sizeof(Cluster)))
   {
-      std::cerr << "Failed to allocate " << mbSize
-                << "MB for transposition table." << std::endl;
-      exit(EXIT_FAILURE);
+      aligned_large_free(m, h.clusterCount * sizeof(Cluster), b);
+      return false;
   }
 
-  table = (Cluster*)((uintptr_t(mem) + CacheLineSize - 1) & ~(CacheLineSize - 1));
+  release(mem, clusterCount, backing);
+  sharedName.clear();
+
+  mem = m;
+  backing = b;
+  table = (Cluster*)mem;
+
+#endif
+
+  clusterCount = h.clusterCount;
+  generation8 = uint8_t(h.generation);
+  justLoaded = true;
+  return true;
 }
 
 
 /// TranspositionTable::clear() overwrites the entire transposition table
 /// with zeros. It is called whenever the table is resized, or when the
-/// user asks the program to clear the table (from the UCI interface).
+/// user asks the program to clear the table (from the UCI interface). The
+/// work is shared among the search threads: as memory pages are physically
+/// allocated on first touch, on NUMA hardware each slice ends up on the node
+/// of the thread that zeroed it. A shared table is left alone, as it holds
+/// the work of other processes too, and so is a table just loaded.
 
 void TranspositionTable::clear() {
 
-  std::memset(table, 0, clusterCount * sizeof(Cluster));
+  if (backing == SHARED_MEMORY || justLoaded)
+      return;
+
+  for_each_slice(clusterCount, [this](size_t start, size_t len) {
+      std::memset(&table[start], 0, len * sizeof(Cluster));
+  });
 }
 
 
@@ -69,49 +445,198 @@ void TranspositionTable::clear() {
 /// Otherwise, it returns false and a pointer to an empty or least valuable TTEntry
 /// to be replaced later. The replace value of an entry is calculated as its depth
 /// minus 8 times its relative age. TTEntry t1 is considered more valuable than
-/// TTEntry t2 if its replace value is greater than that of t2.
+/// TTEntry t2 if its replace value is greater than that of t2. With TT_CHECKSUM
+/// a torn entry is counted in th->ttTorn, emptied and returned as not found.
 
-TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
+TTEntry* TranspositionTable::probe(const Key key, bool& found, Thread* th) const {
 
   TTEntry* const tte = first_entry(key);
-  const uint16_t key16 = key >> 48;  // Use the high 16 bits as key inside the cluster
+  const TTKey keyBits = TTEntry::key_bits(key); // Use the high bits as key inside the cluster
+  const uint8_t gen = generation();
+
+#ifndef TT_CHECKSUM
+  (void)th;
+#endif
 
   for (int i = 0; i < ClusterSize; ++i)
-      if (!tte[i].key16 || tte[i].key16 == key16)
+      if (!tte[i].key || (tte[i].key & TTEntry::KeyMask) == keyBits)
       {
-          if ((tte[i].genBound8 & 0xFC) != generation8 && tte[i].key16)
-              tte[i].genBound8 = uint8_t(generation8 | tte[i].bound()); // Refresh
+#ifdef TT_CHECKSUM
+          if (tte[i].corrupted())
+          {
+              th->ttTorn.fetch_add(1, std::memory_order_relaxed);
+              tte[i].key = 0; // Make save() overwrite all the fields
+              return found = false, &tte[i];
+          }
+#endif
+          if ((tte[i].genBound8 & 0xFC) != gen && tte[i].key)
+              tte[i].genBound8 = uint8_t(gen | tte[i].bound()); // Refresh
 
-          return found = (bool)tte[i].key16, &tte[i];
+          return found = (bool)tte[i].key, &tte[i];
       }
 
-  // Find an entry to be replaced according to the replacement strategy
-  TTEntry* replace = tte;
-  for (int i = 1; i < ClusterSize; ++i)
+  // Find an entry to be replaced according to the replacement strategy. With
+  // TWO_TIER a stale first entry is replaced at once, otherwise it's kept out
+  // of the contest: TTEntry::save() moves the new data up to it if deep enough.
+  int first = 1;
+  if (policy == TWO_TIER)
+  {
+      if (tte[0].generation() != gen)
+          return found = false, &tte[0];
+      first = 2;
+  }
+
+  TTEntry* replace = &tte[first - 1];
+  for (int i = first; i < ClusterSize; ++i)
       // Due to our packed storage format for generation and its cyclic
       // nature we add 259 (256 is the modulus plus 3 to keep the lowest
       // two bound bits from affecting the result) to calculate the entry
       // age correctly even after generation8 overflows into the next cycle.
-      if (  replace->depth8 - ((259 + generation8 - replace->genBound8) & 0xFC) * 2
-          >   tte[i].depth8 - ((259 + generation8 -   tte[i].genBound8) & 0xFC) * 2)
+      if (worth(*replace, gen) > worth(tte[i], gen))
           replace = &tte[i];
 
   return found = false, replace;
 }
 
 
+/// TranspositionTable::set_policy() selects one of the replacement policies
+/// listed in PolicyNames, see ReplacePolicy in tt.h for their description.
+
+void TranspositionTable::set_policy(const std::string& name) {
+
+  auto it = std::find(PolicyNames.begin(), PolicyNames.end(), name);
+  policy = it != PolicyNames.end() ? ReplacePolicy(it - PolicyNames.begin()) : DEPTH_AGE;
+
+  ageWeight = policy == OLDEST ? 64 : 2; // Age prevails over any depth with OLDEST
+
+  for (Bound b : { BOUND_NONE, BOUND_UPPER, BOUND_LOWER, BOUND_EXACT })
+  {
+      boundBonus[b] =  policy != BOUND_AWARE ? 0
+                     : b == BOUND_EXACT ? 4 : b == BOUND_LOWER ? 2 : 0;
+
+      keepMargin[b] =  policy == OLDEST    ? 256
+                     : policy == TWO_TIER  ? 1
+                     : policy == DEPTH_AGE ? 4
+                     : b == BOUND_EXACT    ? 1 : 4;
+  }
+}
+
+
+/// TranspositionTable::layout() describes the cluster layout chosen at compile
+/// time, see the ttcluster flag in the Makefile.
+
+std::string TranspositionTable::layout() {
+
+  return  std::to_string(ClusterSize) + " entries of " + std::to_string(sizeof(TTEntry))
+        + " bytes per " + std::to_string(sizeof(Cluster)) + "-byte cluster, "
+        + std::to_string(8 * sizeof(TTKey) - TTEntry::CheckBits) + "-bit keys"
+        + (TTEntry::CheckBits ? ", " + std::to_string(TTEntry::CheckBits) + "-bit checksum" : "");
+}
+
+
 /// TranspositionTable::hashfull() returns an approximation of the hashtable
 /// occupation during a search. The hash is x permill full, as per UCI protocol.
+/// The sampled clusters are spread over the whole table.
 
 int TranspositionTable::hashfull() const {
 
+  const size_t stride = clusterCount / (1000 / ClusterSize);
+
+  const uint8_t gen = generation();
+
   int cnt = 0;
   for (int i = 0; i < 1000 / ClusterSize; i++)
   {
-      const TTEntry* tte = &table[i].entry[0];
+      const TTEntry* tte = &table[i * stride].entry[0];
       for (int j = 0; j < ClusterSize; j++)
-          if ((tte[j].genBound8 & 0xFC) == generation8)
+          if ((tte[j].genBound8 & 0xFC) == gen)
               cnt++;
   }
   return cnt;
 }
+
+
+/// TranspositionTable::stats() returns a report on the table content, made by
+/// scanning 'samples' clusters evenly spread over the table, or all of them if
+/// 'samples' is zero. Entries are broken down by age (in searches, relative to
+/// the current generation), depth and bound type.
+
+std::string TranspositionTable::stats(size_t samples) const {
+
+  struct Histograms {
+    uint64_t entries, used, age[9], depth[10], bound[4];
+  } total = {};
+
+  const char* BoundNames[] = { "none", "upper", "lower", "exact" };
+  const uint8_t gen = generation();
+  const size_t count  = samples && samples < clusterCount ? samples : clusterCount;
+  const size_t stride = clusterCount / count;
+  Mutex mutex;
+
+  for_each_slice(count, [&](size_t start, size_t len) {
+
+      Histograms h = {};
+
+      for (size_t i = start; i < start + len; ++i)
+          for (const TTEntry& tte : table[i * stride].entry)
+          {
+              h.entries++;
+
+              if (tte.empty())
+                  continue;
+
+              int age = ((259 + gen - tte.genBound8) & 0xFC) / 4;
+
+              h.used++;
+              h.age[std::min(age, 8)]++;
+              h.depth[std::max(0, std::min((tte.depth8 + 3) / 4, 9))]++;
+              h.bound[tte.bound()]++;
+          }
+
+      std::lock_guard<Mutex> lk(mutex);
+
+      total.entries += h.entries;
+      total.used    += h.used;
+      for (int i = 0; i < 9; ++i)
+          total.age[i] += h.age[i];
+      for (int i = 0; i < 10; ++i)
+          total.depth[i] += h.depth[i];
+      for (int i = 0; i < 4; ++i)
+          total.bound[i] += h.bound[i];
+  });
+
+  auto percent = [&](uint64_t n) {
+      std::ostringstream ss;
+      ss << std::fixed << std::setprecision(2) << std::setw(7)
+         << 100.0 * n / std::max(total.used, uint64_t(1)) << "%";
+      return ss.str();
+  };
+
+  std::ostringstream ss;
+
+  ss << "Hash size      : " << (clusterCount * sizeof(Cluster) >> 20) << " MB, "
+     << clusterCount << " clusters"
+     << "\nLayout         : " << layout()
+     << "\nScanned        : " << count << " clusters" << (count == clusterCount ? " (exact)" : " (sampled)")
+     << "\nOccupancy      : " << total.used << " / " << total.entries << " entries ("
+     << std::fixed << std::setprecision(2) << 100.0 * total.used / total.entries << "%)"
+     << "\n\nAge (searches) :";
+
+  for (int i = 0; i < 9; ++i)
+      ss << "\n  " << (i < 8 ? std::to_string(i) + " " : "8+") << "          " << percent(total.age[i]);
+
+  ss << "\n\nDepth (plies)  :";
+
+  for (int i = 0; i < 10; ++i)
+      ss << "\n  " << std::setw(5) << (  i == 0 ? std::string("<= 0")
+                                     : i == 9 ? std::string("33+")
+                                     : std::to_string(4 * i - 3) + "-" + std::to_string(4 * i))
+         << "       " << percent(total.depth[i]);
+
+  ss << "\n\nBound          :";
+
+  for (int i = 0; i < 4; ++i)
+      ss << "\n  " << std::left << std::setw(12) << BoundNames[i] << std::right << percent(total.bound[i]);
+
+  return ss.str();
+}
@@ -21,18 +21,43 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <atomic>
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
 #include "misc.h"
 #include "types.h"
 
-/// TTEntry struct is the 10 bytes transposition table entry, defined as below:
+/// TTEntry struct is the transposition table entry, defined as below:
 ///
-/// key        16 bit
+/// key        16 bit (32 bit with TT_CLUSTER_64)
 /// move       16 bit
 /// value      16 bit
 /// eval value 16 bit
 /// generation  6 bit
 /// bound type  2 bit
 /// depth       8 bit
+///
+/// That is 10 bytes by default, or 12 bytes when the Makefile is invoked with
+/// ttcluster=64, which trades the cluster size for a wider verification key.
+///
+/// With ttcheck=yes (TT_CHECKSUM, requires ttcluster=64) the low 8 bits of the
+/// key hold a checksum of the rest of the entry instead of key bits. Entries
+/// are written field by field without locking, so two threads storing to the
+/// same slot at once may leave an entry mixing both positions: the checksum
+/// detects such torn entries, which probe() then treats as empty.
+
+#if defined(TT_CHECKSUM) && !defined(TT_CLUSTER_64)
+#error "TT_CHECKSUM requires TT_CLUSTER_64"
+#endif
+
+#ifdef TT_CLUSTER_64
+typedef uint32_t TTKey;
+#else
+typedef uint16_t TTKey;
+#endif
 
 struct TTEntry {
 
@@ -41,33 +66,40 @@ struct TTEntry {
   Value eval()  const { return (Value)eval16; }
   Depth depth() const { return (Depth)(depth8 * int(ONE_PLY)); }
   Bound bound() const { return (Bound)(genBound8 & 0x3); }
+  uint8_t generation() const { return genBound8 & 0xFC; }
+  bool empty() const { return !key; }
+
+#ifdef TT_CHECKSUM
+  static const int CheckBits = 8;
 
-  void save(Key k, Value v, Bound b, Depth d, Move m, Value ev, uint8_t g) {
-
-    assert(d / ONE_PLY * ONE_PLY == d);
-
-    // Preserve any existing move for the same position
-    if (m || (k >> 48) != key16)
-        move16 = (uint16_t)m;
-
-    // Don't overwrite more valuable entries
-    if (  (k >> 48) != key16
-        || d / ONE_PLY > depth8 - 4
-     /* || g != (genBound8 & 0xFC) // Matching non-zero keys are already refreshed by probe() */
-        || b == BOUND_EXACT)
-    {
-        key16     = (uint16_t)(k >> 48);
-        value16   = (int16_t)v;
-        eval16    = (int16_t)ev;
-        genBound8 = (uint8_t)(g | b);
-        depth8    = (int8_t)(d / ONE_PLY);
-    }
+  // The checksum covers everything but the generation, which probe() refreshes
+  // alone. The fields are packed and mixed by multiplication, so that a change
+  // in any of them changes the top 8 bits of the product.
+  uint8_t checksum(TTKey k) const {
+    uint64_t x =  uint64_t(k >> 8)
+                | uint64_t(move16) << 24
+                | uint64_t(uint16_t(value16)) << 40
+                | uint64_t(uint8_t(depth8)) << 56;
+    x ^= (uint64_t(uint16_t(eval16)) | uint64_t(genBound8 & 0x3) << 16) * 0x9E3779B97F4A7C15ULL;
+    return uint8_t((x * 0x9E3779B97F4A7C15ULL) >> 56);
   }
 
+  bool corrupted() const { return key && uint8_t(key) != checksum(key); }
+#else
+  static const int CheckBits = 0;
+#endif
+
+  static const TTKey KeyMask = TTKey(~0U << CheckBits);
+
+  // The highest order bits of the key are used to verify the entry
+  static TTKey key_bits(Key k) { return TTKey(k >> (64 - 8 * sizeof(TTKey))) & KeyMask; }
+
+  void save(Key k, Value v, Bound b, Depth d, Move m, Value ev, uint8_t g);
+
 private:
   friend class TranspositionTable;
 
-  uint16_t key16;
+  TTKey    key;
   uint16_t move16;
   int16_t  value16;
   int16_t  eval16;
@@ -76,6 +108,27 @@ private:
 };
 
 
+struct TTFileHeader;
+class Thread;
+
+/// ReplacePolicy selects, with the "TT Replacement" UCI option, how probe()
+/// picks the entry of a full cluster to be replaced by a new position, and
+/// when TTEntry::save() may overwrite the data stored for the same position.
+///
+/// DEPTH_AGE    Keep the entry with the highest depth minus 8 times its age.
+///              Overwrite unless the stored depth is at least 4 plies more.
+/// OLDEST       Replace the oldest entry, then the shallowest. Always overwrite.
+/// TWO_TIER     The first entry of a cluster is depth preferred: it only takes
+///              a position searched at least as deep, or any position once it
+///              is from an older search. The others are always replaced, the
+///              least valuable first, and a save there that qualifies for the
+///              first tier swaps places with it.
+/// BOUND_AWARE  As DEPTH_AGE, but exact and lower bounds are worth 4 and 2
+///              extra plies, and exact bounds are only overwritten with at
+///              least the stored depth.
+
+enum ReplacePolicy { DEPTH_AGE, OLDEST, TWO_TIER, BOUND_AWARE, REPLACE_POLICY_NB };
+
 /// A TranspositionTable consists of a power of 2 number of clusters and each
 /// cluster consists of ClusterSize number of TTEntry. Each non-empty entry
 /// contains information of exactly one position. The size of a cluster should
@@ -86,23 +139,48 @@ private:
 class TranspositionTable {
 
   static const int CacheLineSize = 64;
+
+#ifdef TT_CLUSTER_64
+  static const int ClusterBytes = 64;
+  static const int ClusterSize = 5;
+#else
+  static const int ClusterBytes = 32;
   static const int ClusterSize = 3;
+#endif
 
   struct Cluster {
     TTEntry entry[ClusterSize];
-    char padding[2]; // Align to a divisor of the cache line size
+    char padding[ClusterBytes - ClusterSize * sizeof(TTEntry)]; // Align to a divisor of the cache line size
   };
 
+  static_assert(sizeof(Cluster) == ClusterBytes, "Cluster size incorrect");
   static_assert(CacheLineSize % sizeof(Cluster) == 0, "Cluster size incorrect");
 
 public:
- ~TranspositionTable() { free(mem); }
-  void new_search() { generation8 += 4; } // Lower 2 bits are used by Bound
-  uint8_t generation() const { return generation8; }
-  TTEntry* probe(const Key key, bool& found) const;
+ ~TranspositionTable() { release(mem, clusterCount, backing); }
+  // Lower 2 bits are used by Bound. A shared table keeps the generation in its
+  // header, where the searches of all the attached processes advance it.
+  void new_search() {
+    justLoaded = false;
+    if (backing == SHARED_MEMORY)
+        sharedGeneration->fetch_add(4, std::memory_order_relaxed);
+    else
+        generation8 += 4;
+  }
+  uint8_t generation() const {
+    return backing == SHARED_MEMORY ? uint8_t(sharedGeneration->load(std::memory_order_relaxed))
+                                    : generation8;
+  }
+  TTEntry* probe(const Key key, bool& found, Thread* th) const;
   int hashfull() const;
+  std::string stats(size_t samples) const;
   void resize(size_t mbSize);
   void clear();
+  bool save(const std::string& fname) const;
+  bool load(const std::string& fname);
+  static std::string layout();
+  void set_policy(const std::string& name);
+  static const std::vector<std::string> PolicyNames;
 
   // The lowest order bits of the key are used to get the index of the cluster
   TTEntry* first_entry(const Key key) const {
@@ -110,12 +188,86 @@ public:
   }
 
 private:
+  friend struct TTEntry;
+
+  static void release(void* mem, size_t clusterCount, MemoryBacking backing);
+  void rehash(const Cluster* old, size_t oldCount);
+  bool attach_shared();
+  void fill_header(TTFileHeader& h) const;
+  bool check_header(const TTFileHeader& h) const;
+
+  // The replace value of an entry in generation g, see probe()
+  int worth(const TTEntry& e, uint8_t g) const {
+    return e.depth8 - ((259 + g - e.genBound8) & 0xFC) * ageWeight + boundBonus[e.bound()];
+  }
+
   size_t clusterCount;
   Cluster* table;
   void* mem;
+  MemoryBacking backing;
+  bool largePages;
+  std::string sharedName;
+  ReplacePolicy policy = DEPTH_AGE;
+  int ageWeight = 2;                    // Per unit of ((259 + generation8 - genBound8) & 0xFC)
+  int boundBonus[BOUND_EXACT + 1] = {};
+  int keepMargin[BOUND_EXACT + 1] = { 4, 4, 4, 4 }; // By stored bound, in plies
+  bool justLoaded;      // By load(), with no search since, see clear()
   uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+  std::atomic<uint32_t>* sharedGeneration; // In the header of a shared table
 };
 
 extern TranspositionTable TT;
 
+
+/// TTEntry::save() stores the data of a position. An entry already holding the
+/// same position is only overwritten if the new data is deemed more valuable,
+/// according to the replacement policy of the table.
+
+inline void TTEntry::save(Key k, Value v, Bound b, Depth d, Move m, Value ev, uint8_t g) {
+
+  assert(d / ONE_PLY * ONE_PLY == d);
+
+  int keepMargin = TT.keepMargin[bound()];
+  TTEntry* first = nullptr;
+
+  // With TWO_TIER the second tier entries are always overwritten
+  if (TT.policy == TWO_TIER)
+  {
+      first = (TTEntry*)(uintptr_t(this) & ~uintptr_t(TranspositionTable::ClusterBytes - 1));
+      if (first != this)
+          keepMargin = 256;
+  }
+
+  // Preserve any existing move for the same position
+  if (m || key_bits(k) != (key & KeyMask))
+      move16 = (uint16_t)m;
+
+  // Don't overwrite more valuable entries
+  if (  key_bits(k) != (key & KeyMask)
+      || d / ONE_PLY > depth8 - keepMargin
+   /* || g != (genBound8 & 0xFC) // Matching non-zero keys are already refreshed by probe() */
+      || b == BOUND_EXACT)
+  {
+      value16   = (int16_t)v;
+      eval16    = (int16_t)ev;
+      genBound8 = (uint8_t)(g | b);
+      depth8    = (int8_t)(d / ONE_PLY);
+#ifdef TT_CHECKSUM
+      key       = key_bits(k) | checksum(key_bits(k)); // Last and in one store
+#else
+      key       = key_bits(k);
+#endif
+  }
+#ifdef TT_CHECKSUM
+  else
+      key = (key & KeyMask) | checksum(key & KeyMask); // The move may have changed
+#endif
+
+  // Move up to the first tier when at least as deep as the entry there, or
+  // when that one is stale.
+  if (   first && first != this
+      && (depth8 >= first->depth8 || first->generation() != g))
+      std::swap(*first, *this);
+}
+
 #endif // #ifndef TT_H_INCLUDED
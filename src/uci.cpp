@@ -18,12 +18,17 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <cassert>
+#include <iomanip>
 #include <iostream>
 #include <sstream>
 #include <string>
+#include <thread>
 
+#include "cluster.h"
 #include "evaluate.h"
+#include "bitboard.h"
 #include "movegen.h"
 #include "position.h"
 #include "search.h"
@@ -75,6 +80,8 @@ namespace {
         states->emplace_back();
         pos.do_move(m, states->back());
     }
+
+    Cluster::set_position(is.str());
   }
 
 
@@ -129,6 +136,7 @@ namespace {
         else if (token == "movetime")  is >> limits.movetime;
         else if (token == "mate")      is >> limits.mate;
         else if (token == "perft")     is >> limits.perft;
+        else if (token == "divide")    limits.divide = 1;
         else if (token == "infinite")  limits.infinite = 1;
         else if (token == "ponder")    ponderMode = true;
 
@@ -136,16 +144,105 @@ namespace {
   }
 
 
-  // bench() is called when engine receives the "bench" command. Firstly
-  // a list of UCI commands is setup according to bench parameters, then
-  // it is run one by one printing a summary at the end.
+  // tt() is called when engine receives the "tt" command. "tt save <file>"
+  // dumps the transposition table to a file and "tt load <file>" maps it back,
+  // so that a restarted engine does not have to search again what it already
+  // knows. A loaded table is kept by a "ucinewgame" before the first search,
+  // later ones clear it as usual.
+  // "tt stats [<clusters>]" reports on the table content, sampling only the
+  // given number of clusters if any, and on the entries that the last search
+  // replaced (written by an earlier search) or overwrote (written by itself),
+  // and found torn.
 
-  void bench(Position& pos, istream& args, StateListPtr& states) {
+  void tt(istringstream& is) {
+
+    string token, arg;
+    is >> token >> arg;
+
+    Threads.main()->wait_for_search_finished();
+
+    if (token == "save" && !arg.empty())
+        sync_cout << "info string " << (TT.save(arg) ? "Saved" : "Failed to save")
+                  << " hash to " << arg << sync_endl;
+
+    else if (token == "load" && !arg.empty())
+        sync_cout << "info string " << (TT.load(arg) ? "Loaded" : "Failed to load")
+                  << " hash from " << arg << sync_endl;
+
+    else if (token == "stats")
+    {
+        size_t samples = 0;
+        istringstream(arg) >> samples;
+
+        sync_cout << TT.stats(samples)
+                  << "\n\nLast search    :"
+                  << "\n  replaced    " << Threads.tt_replacements()
+                  << "\n  overwritten " << Threads.tt_overwrites()
+                  << "\n  torn        " << (TTEntry::CheckBits ? std::to_string(Threads.tt_torn())
+                                                           : "not checked, see ttcheck in the Makefile")
+                  << sync_endl;
+    }
+    else
+        sync_cout << "Usage: tt save|load <file> or tt stats [<clusters>]" << sync_endl;
+  }
+
+
+  // stats() is called when engine receives the "stats" command. It reports the
+  // search statistics of the last search, summed over all threads. They are
+  // only counted when built with stats=yes, see SearchStats in thread.h.
+
+  void stats() {
+
+    typedef SearchStats S;
+
+    Threads.main()->wait_for_search_finished();
+
+    if (!S::Enabled)
+    {
+        sync_cout << "Search statistics not counted, see stats in the Makefile" << sync_endl;
+        return;
+    }
+
+    auto pct = [](S::Counter num, S::Counter den) {
+        uint64_t n = Threads.search_stats(num), d = Threads.search_stats(den);
+        ostringstream ss;
+        ss << fixed << setprecision(1) << setw(5) << 100.0 * n / std::max(d, uint64_t(1))
+           << "% of " << d;
+        return ss.str();
+    };
+
+    uint64_t nodes = Threads.nodes_searched(), qnodes = Threads.search_stats(S::QSearchNodes);
+    uint64_t loops = Threads.search_stats(S::PickerLoops);
+
+    sync_cout << "Last search (" << Threads.size() << " threads):"
+              << "\n  TT hits            : " << pct(S::TTHits, S::TTProbes) << " probes"
+              << "\n  First move cutoffs : " << pct(S::FirstMoveCutoffs, S::BetaCutoffs) << " cutoffs"
+              << "\n  Null move cutoffs  : " << pct(S::NullMoveCutoffs, S::NullMoveTries) << " tries"
+              << "\n  LMR re-searches    : " << pct(S::LmrResearches, S::LmrSearches) << " reduced searches"
+              << "\n  QSearch nodes      : " << fixed << setprecision(1) << setw(5)
+                                             << 100.0 * qnodes / std::max(nodes, uint64_t(1))
+                                             << "% of " << nodes << " nodes"
+              << "\n  MovePicker stage   : " << setprecision(2) << setw(5)
+                                             << double(Threads.search_stats(S::PickerStages)) / std::max(loops, uint64_t(1))
+                                             << " on average over " << loops << " move loops not in check"
+              << "\n                       (1 TT move, 2 captures, 3-4 killers, 5 countermove, 6 quiets, 7 the rest)"
+              << sync_endl;
+  }
+
+
+  // run_bench() runs one by one the UCI commands of a list built by setup_bench()
+  // and returns the time it took, adding up the nodes searched, pseudo-illegal TT
+  // moves (see check_tt_move() in movepick.cpp) and TT torn entries.
+  // The best move and score found for each position are appended to 'best', if
+  // given.
+
+  TimePoint run_bench(Position& pos, const vector<string>& list, StateListPtr& states,
+                      uint64_t& nodes, uint64_t& ttFalseHits, uint64_t& ttTorn,
+                      vector<pair<Move, Value>>* best = nullptr) {
 
     string token;
-    uint64_t num, nodes = 0, cnt = 1;
+    uint64_t num, cnt = 1;
 
-    vector<string> list = setup_bench(pos, args);
     num = count_if(list.begin(), list.end(), [](string s) { return s.find("go ") == 0; });
 
     TimePoint elapsed = now();
@@ -161,20 +258,303 @@ namespace {
             go(pos, is, states);
             Threads.main()->wait_for_search_finished();
             nodes += Threads.nodes_searched();
+            ttFalseHits += Threads.tt_false_hits();
+            ttTorn += Threads.tt_torn();
+
+            if (best)
+                best->emplace_back(Threads.main()->bestMove, Threads.main()->previousScore);
         }
         else if (token == "setoption")  setoption(is);
         else if (token == "position")   position(pos, is, states);
         else if (token == "ucinewgame") Search::clear();
     }
 
-    elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+    return now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+  }
+
+
+  // bench_tt() is called by "bench tt", with the same parameters as bench.
+  // It runs the bench once for each TT replacement policy, then prints a table
+  // with the time taken by each one to search the positions to the same depth.
+  // The policies are described with ReplacePolicy in tt.h.
+
+  void bench_tt(Position& pos, istream& args, StateListPtr& states) {
+
+    const string current = Options["TT Replacement"];
+    const vector<string> list = setup_bench(pos, args);
+    vector<TimePoint> elapsed;
+    vector<uint64_t> nodes;
+
+    for (const string& policy : TranspositionTable::PolicyNames)
+    {
+        uint64_t n = 0, ttFalseHits = 0, ttTorn = 0;
+
+        Options["TT Replacement"] = policy;
+        elapsed.push_back(run_bench(pos, list, states, n, ttFalseHits, ttTorn));
+        nodes.push_back(n);
+    }
+
+    Options["TT Replacement"] = current;
+
+    cerr << "\n==========================="
+         << "\nPolicy        Time (ms)   Relative        Nodes   Nodes/second";
+
+    for (size_t i = 0; i < elapsed.size(); ++i)
+        cerr << "\n" << left << setw(12) << TranspositionTable::PolicyNames[i] << right
+             << setw(11) << elapsed[i]
+             << setw(10) << fixed << setprecision(1) << 100.0 * elapsed[i] / elapsed[0] << "%"
+             << setw(13) << nodes[i]
+             << setw(15) << 1000 * nodes[i] / elapsed[i];
+
+    cerr << endl;
+  }
+
+
+  // bench_scaling() is called by "bench scaling [maxThreads ttSize depth fenFile]".
+  // It searches the positions to the given depth with 1, 2, 4... threads up to
+  // maxThreads (by default the number of hardware threads), then prints for each
+  // thread count the time to depth, the speed, the speedup and efficiency over
+  // one thread, and how often the best move matches the one of a single thread,
+  // along with the mean score difference. A JSON copy of the table follows on a
+  // single line, starting with '{'.
+
+  void bench_scaling(Position& pos, istream& args, StateListPtr& states) {
+
+    struct Run {
+      size_t threads;
+      TimePoint elapsed;
+      uint64_t nodes;
+      vector<pair<Move, Value>> best;
+    };
+
+    string token;
+    size_t maxThreads = std::thread::hardware_concurrency();
+    if (args >> token)
+        istringstream(token) >> maxThreads;
+    string ttSize  = (args >> token) ? token : "16";
+    string depth   = (args >> token) ? token : "13";
+    string fenFile = (args >> token) ? token : "default";
+    vector<size_t> counts;
+    vector<Run> runs;
+
+    for (size_t threads = 1; threads < maxThreads; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(std::max(maxThreads, size_t(1)));
+
+    for (size_t threads : counts)
+    {
+        istringstream is(ttSize + " " + to_string(threads) + " " + depth + " " + fenFile + " depth");
+        Run r = { threads, 0, 0, {} };
+        uint64_t ttFalseHits = 0, ttTorn = 0;
+
+        r.elapsed = run_bench(pos, setup_bench(pos, is), states, r.nodes, ttFalseHits, ttTorn, &r.best);
+        runs.push_back(r);
+    }
+
+    ostringstream table, json;
+
+    table << "\n==========================="
+          << "\nThreads  Time (ms)  Nodes/second  Speedup  Efficiency  Same move  Score diff (cp)";
+    json << "{\"depth\":" << depth << ",\"hash\":" << ttSize << ",\"positions\":" << runs[0].best.size()
+         << ",\"runs\":[";
+
+    for (const Run& r : runs)
+    {
+        double speedup = double(runs[0].elapsed) / r.elapsed;
+        int same = 0;
+        int64_t scoreDiff = 0;
+
+        for (size_t i = 0; i < r.best.size(); ++i)
+        {
+            same += r.best[i].first == runs[0].best[i].first;
+            scoreDiff += std::abs(r.best[i].second - runs[0].best[i].second);
+        }
+
+        double samePct = 100.0 * same / std::max(r.best.size(), size_t(1));
+        double meanDiff = 100.0 * scoreDiff / PawnValueEg / std::max(r.best.size(), size_t(1));
+
+        table << "\n" << setw(7) << r.threads
+              << setw(11) << r.elapsed
+              << setw(14) << 1000 * r.nodes / r.elapsed
+              << fixed << setprecision(2)
+              << setw(9) << speedup
+              << setw(12) << speedup / r.threads
+              << setw(10) << setprecision(1) << samePct << "%"
+              << setw(17) << meanDiff;
+
+        json << (&r != &runs[0] ? "," : "")
+             << "{\"threads\":" << r.threads
+             << ",\"time_ms\":" << r.elapsed
+             << ",\"nodes\":" << r.nodes
+             << ",\"nps\":" << 1000 * r.nodes / r.elapsed
+             << setprecision(4)
+             << ",\"speedup\":" << speedup
+             << ",\"efficiency\":" << speedup / r.threads
+             << ",\"same_move_pct\":" << samePct
+             << ",\"mean_score_diff_cp\":" << meanDiff << "}";
+    }
+
+    json << "]}";
+
+    cerr << table.str() << "\n\n" << json.str() << endl;
+  }
+
+
+  // bench_wake() is called by "bench wake [maxThreads spinWait runs]". For 1, 2,
+  // 4... threads up to maxThreads (by default 256) it runs "go depth 1" on the
+  // start position the given number of times (by default 20), first without
+  // spinning and then with the given "Spin Wait" budget (by default 1000 us).
+  // It prints the average and worst time from "go" until a thread is woken up to
+  // search, and the average time from "go" until the search is over.
+
+  void bench_wake(Position& pos, istream& args, StateListPtr& states) {
+
+    using namespace std::chrono;
+
+    string token;
+    size_t maxThreads = 256;
+    int spin = 1000, runs = 20;
+    if (args >> token)
+        istringstream(token) >> maxThreads;
+    if (args >> token)
+        istringstream(token) >> spin;
+    if (args >> token)
+        istringstream(token) >> runs;
+
+    const int threads = Options["Threads"], spinWait = Options["Spin Wait"];
+    ostringstream table;
+
+    table << "\n==========================="
+          << "\nThreads  Spin (us)  Wake avg (us)  Wake max (us)  Go to end (us)";
+
+    for (size_t n = 1; n <= maxThreads; n *= 2)
+        for (int budget : { 0, spin })
+        {
+            Options["Threads"] = to_string(n);
+            Options["Spin Wait"] = to_string(budget);
+
+            int64_t wakeSum = 0, wakeMax = 0, total = 0;
+
+            for (int i = 0; i < runs; ++i)
+            {
+                istringstream posArgs("startpos"), goArgs("depth 1");
+                position(pos, posArgs, states);
+
+                auto start = steady_clock::now();
+                go(pos, goArgs, states);
+                Threads.main()->wait_for_search_finished();
+                total += duration_cast<microseconds>(steady_clock::now() - start).count();
+
+                for (Thread* th : Threads)
+                {
+                    int64_t wake = duration_cast<microseconds>(th->wakeTime - start).count();
+                    wakeSum += wake;
+                    wakeMax = std::max(wakeMax, wake);
+                }
+            }
+
+            table << "\n" << setw(7) << n
+                  << setw(11) << budget
+                  << setw(15) << wakeSum / int64_t(runs * n)
+                  << setw(15) << wakeMax
+                  << setw(16) << total / runs;
+        }
+
+    Options["Threads"] = to_string(threads);
+    Options["Spin Wait"] = to_string(spinWait);
+
+    cerr << table.str() << endl;
+  }
+
+
+  // bench_rook() is called by "bench rook [millions]". It times the given number
+  // of millions (by default 100) of attacks_bb<ROOK>() calls, over a fixed set of
+  // random squares and occupancies, with the rook attacks chosen at build time.
+  // The checksum of the attacks must not depend on that choice.
+
+  void bench_rook(istream& args) {
+
+    const int Size = 4096;
+    Square squares[Size];
+    Bitboard occupancies[Size], checksum = 0;
+    int64_t millions = 100;
+    PRNG rng(1070372);
+
+    args >> millions;
+
+    for (int i = 0; i < Size; ++i)
+    {
+        squares[i] = Square(rng.rand<unsigned>() % SQUARE_NB);
+        occupancies[i] = rng.sparse_rand<Bitboard>() | squares[i];
+    }
+
+    TimePoint elapsed = now();
+
+    for (int64_t n = 0; n < millions * 1000000 / Size; ++n)
+        for (int i = 0; i < Size; ++i)
+            checksum += attacks_bb<ROOK>(squares[i], occupancies[i] ^ Bitboard(n));
+
+    elapsed = now() - elapsed + 1;
+
+#if defined(ROOK_KINDERGARTEN)
+    const char* generator = "kindergarten";
+#elif defined(ROOK_HQ)
+    const char* generator = "hq";
+#else
+    const char* generator = HasPext ? "magic (pext)" : "magic";
+#endif
+
+    cerr << "\n==========================="
+         << "\nRook attacks    : " << generator
+         << "\nLookups         : " << millions * 1000000 / Size * Size
+         << "\nTotal time (ms) : " << elapsed
+         << "\nNanoseconds     : " << fixed << setprecision(2)
+                                    << 1e6 * elapsed / std::max(millions * 1000000 / Size * Size, int64_t(1))
+         << "\nChecksum        : " << hex << checksum << dec << endl;
+  }
+
+
+  // bench() is called when engine receives the "bench" command. Firstly
+  // a list of UCI commands is setup according to bench parameters, then
+  // it is run one by one printing a summary at the end. "bench tt",
+  // "bench scaling", "bench wake" and "bench rook" are handed over to
+  // bench_tt(), bench_scaling(), bench_wake() and bench_rook().
+
+  void bench(Position& pos, istream& args, StateListPtr& states) {
+
+    string token;
+    uint64_t nodes = 0, ttFalseHits = 0, ttTorn = 0;
+
+    streampos start = args.tellg();
+    if (   (args >> token)
+        && (token == "tt" || token == "scaling" || token == "wake" || token == "rook"))
+    {
+        token == "tt"      ? bench_tt(pos, args, states)
+      : token == "scaling" ? bench_scaling(pos, args, states)
+      : token == "wake"    ? bench_wake(pos, args, states)
+                           : bench_rook(args);
+        return;
+    }
+    args.clear();
+    args.seekg(start);
+
+    TimePoint elapsed = run_bench(pos, setup_bench(pos, args), states, nodes, ttFalseHits, ttTorn);
 
     dbg_print(); // Just before exiting
 
     cerr << "\n==========================="
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
-         << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
+         << "\nNodes/second    : " << 1000 * nodes / elapsed
+         << "\nTT layout       : " << TT.layout()
+         << "\nTT bad moves    : " << ttFalseHits << " ("
+         << 1000000.0 * ttFalseHits / std::max(nodes, uint64_t(1))
+         << " per Mnodes, pseudo-illegal TT moves, a lower bound on false hits)";
+
+    if (TTEntry::CheckBits)
+        cerr << "\nTT torn entries : " << ttTorn;
+
+    cerr << endl;
   }
 
 } // namespace
@@ -215,10 +595,17 @@ void UCI::loop(int argc, char* argv[]) {
       if (    token == "quit"
           ||  token == "stop"
           || (token == "ponderhit" && Threads.stopOnPonderhit))
+      {
           Threads.stop = true;
+          Threads.wake_up();
+          Cluster::stop();
+      }
 
       else if (token == "ponderhit")
+      {
           Threads.ponder = false; // Switch to normal search
+          Threads.wake_up();
+      }
 
       else if (token == "uci")
           sync_cout << "id name " << engine_info(true)
@@ -234,6 +621,15 @@ void UCI::loop(int argc, char* argv[]) {
       // Additional custom non-UCI commands, mainly for debugging
       else if (token == "flip")  pos.flip();
       else if (token == "bench") bench(pos, is, states);
+      else if (token == "tt")    tt(is);
+      else if (token == "stats") stats();
+      else if (token == "cluster")
+      {
+          string sub, address;
+          is >> sub >> address;
+          if (sub == "serve" && Cluster::serve(address))
+              argc = 1; // Keep reading commands, now from the master
+      }
       else if (token == "d")     sync_cout << pos << sync_endl;
       else if (token == "eval")  sync_cout << Eval::trace(pos) << sync_endl;
       else
@@ -22,6 +22,7 @@
 #include <cassert>
 #include <ostream>
 
+#include "cluster.h"
 #include "misc.h"
 #include "search.h"
 #include "thread.h"
@@ -38,8 +39,13 @@ namespace UCI {
 /// 'On change' actions, triggered by an option's value change
 void on_clear_hash(const Option&) { Search::clear(); }
 void on_hash_size(const Option& o) { TT.resize(o); }
+void on_hash_memory(const Option&) { TT.resize(Options["Hash"]); }
+void on_tt_policy(const Option& o) { TT.set_policy(o); }
 void on_logger(const Option& o) { start_logger(o); }
 void on_threads(const Option& o) { Threads.set(o); }
+void on_thread_affinity(const Option&) { size_t n = Threads.size(); Threads.exit(); Threads.init(n); Search::clear(); }
+void on_spin_wait(const Option& o) { Threads.spinWait = o; }
+void on_cluster_workers(const Option& o) { Cluster::connect(o); }
 void on_tb_path(const Option& o) { Tablebases::init(o); }
 
 
@@ -60,8 +66,16 @@ void init(OptionsMap& o) {
   o["Debug Log File"]        << Option("", on_logger);
   o["Contempt"]              << Option(0, -100, 100);
   o["Threads"]               << Option(1, 1, 512, on_threads);
+  o["Thread Affinity"]       << Option("<empty>", on_thread_affinity);
+  o["Cooperative Search"]    << Option(false);
+  o["Shared History"]        << Option(false);
+  o["Spin Wait"]             << Option(0, 0, 100000, on_spin_wait);
+  o["Cluster Workers"]       << Option("<empty>", on_cluster_workers); // No authentication, see cluster.h
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["Large Pages"]           << Option(true, on_hash_memory);
+  o["Shared Hash"]           << Option("<empty>", on_hash_memory);
+  o["TT Replacement"]        << Option("Depth-Age", TranspositionTable::PolicyNames, on_tt_policy);
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
@@ -0,0 +1,61 @@
+#!/bin/bash
+# verify the cluster mode: a master and two worker processes on Unix sockets
+# must agree on a best move, and the workers must quit with the master. A
+# worker killed in the middle of a search must not hang the master.
+
+error()
+{
+  echo "cluster testing failed on line $1"
+  kill $w1 $w2 2>/dev/null
+  rm -f $sock1 $sock2 cluster.out
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "cluster testing started"
+
+sock1=/tmp/stockfish-cluster-$$-1
+sock2=/tmp/stockfish-cluster-$$-2
+
+./stockfish cluster serve $sock1 > /dev/null &
+w1=$!
+./stockfish cluster serve $sock2 > /dev/null &
+w2=$!
+
+for i in $(seq 1 50)
+do
+  test -S $sock1 && test -S $sock2 && break
+  sleep 0.1
+done
+
+( echo "setoption name Cluster Workers value $sock1,$sock2"
+  echo "position startpos moves e2e3"
+  echo "go depth 10"
+  sleep 5
+  echo "go movetime 1000"
+  sleep 2
+  echo "go infinite"
+  sleep 1
+  echo "stop"
+  sleep 1
+  echo "go infinite"
+  sleep 1
+  kill $w2
+  sleep 1
+  echo "stop"
+  sleep 1
+  echo "go depth 8"
+  sleep 2
+  echo "quit" ) | ./stockfish > cluster.out
+
+grep -q "Cluster of 2 workers" cluster.out
+test $(grep -c "^bestmove" cluster.out) -eq 5
+test $(grep -c "Cluster best move from" cluster.out) -eq 5
+
+# the workers quit when the master closes the connections
+wait $w1
+wait $w2 || true
+
+rm -f cluster.out
+
+echo "cluster testing OK"
@@ -0,0 +1,48 @@
+#!/bin/bash
+# compare the time to depth and the speed of the search with and without the
+# "Cooperative Search" option, at several thread counts.
+# With a single thread the option has nothing to act on, so the bench signature
+# must be the same with and without it.
+# usage: ../tests/cooperative.sh [depth] [hash], run from src/ after a build
+
+error()
+{
+  echo "cooperative search comparison failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+depth=${1:-16}
+hash=${2:-256}
+
+echo "cooperative search comparison started"
+
+signature()
+{
+  printf "setoption name Cooperative Search value $1\nbench\nquit\n" | ./stockfish 2>&1 | grep "Nodes searched  : " | awk '{print $4}'
+}
+
+reference=$(signature false)
+obtained=$(signature true)
+
+if [ "$reference" != "$obtained" ]; then
+  echo "signature mismatch with a single thread: reference $reference obtained $obtained"
+  exit 1
+fi
+
+printf "%8s %12s %12s %14s\n" threads cooperative "time (ms)" nodes/second
+
+for threads in 8 32 128
+do
+  for coop in false true
+  do
+    out=$(printf "setoption name Cooperative Search value $coop\nbench $hash $threads $depth\nquit\n" | ./stockfish 2>&1)
+    time=$(echo "$out" | grep "Total time" | awk '{print $5}')
+    nps=$(echo "$out" | grep "Nodes/second" | awk '{print $3}')
+    nodes=$(echo "$out" | grep "Nodes searched" | awk '{print $4}')
+    test "$nodes" -gt 0
+    printf "%8s %12s %12s %14s\n" $threads $coop $time $nps
+  done
+done
+
+echo "cooperative search comparison OK"
@@ -0,0 +1,64 @@
+#!/bin/bash
+# compare the default make/unmake perft with the copy-make one (copymake=yes)
+# on the bench positions, and check that both find the same number of leaf
+# nodes, the known one at depths 5 and 6. The search itself always uses
+# Position, so both builds must also have the same bench signature. Note that
+# with copymake=yes perft counts the moves of Board::generate() in perft.cpp,
+# not those of movegen.cpp, so that build checks the copy-make generator
+# against the default one, not movegen.cpp.
+# usage: ../tests/copymake.sh [depth] [arch], run from src/. Both builds are
+# made in a temporary copy of src/, the build in src/ is left alone.
+
+error()
+{
+  echo "copymake comparison failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+depth=${1:-6}
+arch=${2:-x86-64-modern}
+
+case $depth in
+  5) reference=156153805 ;;
+  6) reference=4709795049 ;;
+esac
+
+tmp=$(mktemp -d)
+trap 'rm -rf $tmp' EXIT
+cp -r . $tmp
+cd $tmp
+
+echo "copymake comparison started"
+printf "%9s %14s %12s %14s %14s %10s\n" copymake "leaf nodes" "time (ms)" "perft nps" "search nps" signature
+
+for copymake in no yes
+do
+  make objclean > /dev/null
+  make -j build ARCH=$arch copymake=$copymake > /dev/null 2>&1
+  out=$(./stockfish bench 16 1 $depth default perft 2>&1)
+  nodes=$(echo "$out" | grep "Nodes searched:" | awk '{ sum += $3 } END { printf "%.0f", sum }')
+  time=$(echo "$out" | grep "Total time" | awk '{print $5}')
+  out=$(./stockfish bench 2>&1)
+  nps=$(echo "$out" | grep "Nodes/second" | awk '{print $3}')
+  signature=$(echo "$out" | grep "Nodes searched  : " | awk '{print $4}')
+  printf "%9s %14s %12s %14s %14s %10s\n" $copymake $nodes $time $((1000 * nodes / time)) $nps $signature
+  eval "nodes_$copymake=$nodes signature_$copymake=$signature"
+done
+
+if [ "$nodes_no" != "$nodes_yes" ]; then
+  echo "leaf node counts differ"
+  exit 1
+fi
+
+if [ -n "$reference" ] && [ "$nodes_no" != "$reference" ]; then
+  echo "leaf node count mismatch: reference $reference obtained $nodes_no"
+  exit 1
+fi
+
+if [ "$signature_no" != "$signature_yes" ]; then
+  echo "bench signatures differ"
+  exit 1
+fi
+
+echo "copymake comparison OK"
@@ -0,0 +1,52 @@
+#!/bin/bash
+# compare the perft speed of the default move generation with the bulk one of
+# the leapers (bulkgen=yes), on the bench positions, and check that both find
+# the same number of leaf nodes, the known one at depths 5 and 6
+# usage: ../tests/movegen.sh [depth] [arch], run from src/. Both builds are made
+# in a temporary copy of src/, the build in src/ is left alone.
+
+error()
+{
+  echo "movegen comparison failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+depth=${1:-5}
+arch=${2:-x86-64-modern}
+
+case $depth in
+  5) reference=156153805 ;;
+  6) reference=4709795049 ;;
+esac
+
+tmp=$(mktemp -d)
+trap 'rm -rf $tmp' EXIT
+cp -r . $tmp
+cd $tmp
+
+echo "movegen comparison started"
+printf "%8s %14s %12s %14s\n" bulkgen "leaf nodes" "time (ms)" nodes/second
+
+for bulkgen in no yes
+do
+  make objclean > /dev/null
+  make -j build ARCH=$arch bulkgen=$bulkgen > /dev/null 2>&1
+  out=$(./stockfish bench 16 1 $depth default perft 2>&1)
+  nodes=$(echo "$out" | grep "Nodes searched:" | awk '{ sum += $3 } END { printf "%.0f", sum }')
+  time=$(echo "$out" | grep "Total time" | awk '{print $5}')
+  printf "%8s %14s %12s %14s\n" $bulkgen $nodes $time $((1000 * nodes / time))
+  eval "nodes_$bulkgen=$nodes"
+done
+
+if [ "$nodes_no" != "$nodes_yes" ]; then
+  echo "leaf node counts differ"
+  exit 1
+fi
+
+if [ -n "$reference" ] && [ "$nodes_no" != "$reference" ]; then
+  echo "leaf node count mismatch: reference $reference obtained $nodes_no"
+  exit 1
+fi
+
+echo "movegen comparison OK"
@@ -1,5 +1,7 @@
 #!/bin/bash
-# verify perft numbers (positions from https://chessprogramming.wikispaces.com/Perft+Results)
+# verify perft numbers on the Shatranj positions of tests/perft.epd and report
+# the speed on each of them
+# usage: ../tests/perft.sh [threads] [hash], run from src/
 
 error()
 {
@@ -8,20 +10,32 @@ error()
 }
 trap 'error ${LINENO}' ERR
 
+threads=${1:-1}
+hash=${2:-16}
+suite=$(dirname $0)/perft.epd
+failed=0
+
 echo "perft testing started"
+printf "%-60s %5s %12s %14s\n" position depth "leaf nodes" nodes/second
+
+while IFS=';' read fen depth expected
+do
+  case "$fen" in \#*|"") continue ;; esac
 
-cat << EOF > perft.exp
-   set timeout 10
-   lassign \$argv pos depth result
-   spawn ./stockfish
-   send "position \$pos\\ngo perft \$depth\\n"
-   expect "Nodes searched? \$result" {} timeout {exit 1}
-   send "quit\\n"
-   expect eof
-EOF
+  out=$(printf "setoption name Threads value $threads\nsetoption name Hash value $hash\nposition fen $fen\ngo perft $depth\nquit\n" | ./stockfish)
+  nodes=$(echo "$out" | grep "Nodes searched" | awk '{print $3}')
+  nps=$(echo "$out" | grep "Nodes/second" | awk '{print $3}')
+  printf "%-60s %5s %12s %14s\n" "$fen" $depth $nodes $nps
 
-expect perft.exp startpos 5 1164248 > /dev/null
+  if [ "$nodes" != "$expected" ]; then
+    echo "expected $expected leaf nodes"
+    failed=1
+  fi
+done < $suite
 
-rm perft.exp
+if [ $failed != 0 ]; then
+  echo "perft testing failed"
+  exit 1
+fi
 
 echo "perft testing OK"
@@ -0,0 +1,68 @@
+#!/bin/bash
+# verify that the engine doesn't burn CPU while waiting for "stop" or
+# "ponderhit" after a pondering search has reached its maximum depth
+
+error()
+{
+  echo "ponder testing failed on line $1"
+  echo quit >&3
+  rm -f engine1.in engine1.out
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "ponder testing started"
+
+# CPU time (user + system) of a process, in clock ticks
+cputime()
+{
+  awk '{print $14 + $15}' /proc/$1/stat
+}
+
+rm -f engine1.in engine1.out
+mkfifo engine1.in
+./stockfish < engine1.in > engine1.out &
+pid=$!
+exec 3> engine1.in
+
+echo "position startpos" >&3
+echo "go ponder depth 8" >&3
+
+for i in $(seq 1 100)
+do
+  grep -q "info depth 8 " engine1.out && break
+  sleep 0.1
+done
+
+grep -q "info depth 8 " engine1.out
+sleep 0.5
+
+ticks=$(getconf CLK_TCK)
+before=$(cputime $pid)
+sleep 2
+after=$(cputime $pid)
+
+# the search is over, no best move may be sent before "ponderhit"
+! grep -q bestmove engine1.out
+
+usage=$(( (after - before) * 100 / (2 * ticks) ))
+echo "CPU usage while waiting for ponderhit: $usage%"
+test $usage -lt 10
+
+echo "ponderhit" >&3
+
+for i in $(seq 1 50)
+do
+  grep -q bestmove engine1.out && break
+  sleep 0.1
+done
+
+grep -q bestmove engine1.out
+
+echo quit >&3
+exec 3>&-
+wait
+
+rm -f engine1.in engine1.out
+
+echo "ponder testing OK"
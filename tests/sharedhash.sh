@@ -0,0 +1,56 @@
+#!/bin/bash
+# verify that two engine processes can share one transposition table
+
+error()
+{
+  echo "shared hash testing failed on line $1"
+  echo quit >&3
+  rm -f /dev/shm/$name engine1.in engine1.out
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "shared hash testing started"
+
+name=sf-shared-hash-test-$$
+
+# first engine creates the shared table, fills it and stays attached
+rm -f engine1.in engine1.out
+mkfifo engine1.in
+./stockfish < engine1.in > engine1.out &
+exec 3> engine1.in
+
+echo "setoption name Shared Hash value $name" >&3
+echo "position startpos" >&3
+echo "go depth 12" >&3
+
+for i in $(seq 1 100)
+do
+  grep -q bestmove engine1.out && break
+  sleep 0.1
+done
+
+grep -q "on shared memory" engine1.out
+grep -q bestmove engine1.out
+
+# second engine attaches to the same segment and must find the entries stored
+# by the first one, without searching
+out=$(printf "setoption name Shared Hash value $name\ntt stats\nquit\n" | ./stockfish)
+
+echo "$out" | grep -q "on shared memory"
+used=$(echo "$out" | grep "Occupancy" | awk '{print $3}')
+echo "entries found by the second engine: $used"
+test "$used" -gt 0
+
+# the table generation is shared too, so those entries are from the current
+# search for the second engine as well
+age0=$(echo "$out" | grep -A1 "Age (searches)" | tail -1 | awk '{print $2}')
+test "$age0" = "100.00%"
+
+echo quit >&3
+exec 3>&-
+wait
+
+rm -f /dev/shm/$name engine1.in engine1.out
+
+echo "shared hash testing OK"
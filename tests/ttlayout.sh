@@ -0,0 +1,50 @@
+#!/bin/bash
+# compare the transposition table layouts selectable with 'make ttcluster=...'
+# and 'make ttcheck=...', and check that each build reports its layout and,
+# with a single thread, finds no torn entries
+# usage: ../tests/ttlayout.sh [arch] [bench arguments], run from src/. The builds
+# are made in a temporary copy of src/, the build in src/ is left alone.
+
+error()
+{
+  echo "tt layout comparison failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+arch=${1:-x86-64}
+shift || true
+args=${@:-16 1 15}
+threads=$(echo $args | awk '{print $2}')
+
+tmp=$(mktemp -d)
+trap 'rm -rf $tmp' EXIT
+cp -r . $tmp
+cd $tmp
+
+echo "tt layout comparison started"
+
+for layout in "ttcluster=32" "ttcluster=64" "ttcluster=64 ttcheck=yes"
+do
+  case "$layout" in
+    "ttcluster=32") expected="3 entries of 10 bytes per 32-byte cluster, 16-bit keys" ;;
+    "ttcluster=64") expected="5 entries of 12 bytes per 64-byte cluster, 32-bit keys" ;;
+    *)              expected="5 entries of 12 bytes per 64-byte cluster, 24-bit keys, 8-bit checksum" ;;
+  esac
+
+  make clean > /dev/null
+  make -j2 ARCH=$arch $layout build > /dev/null 2>&1
+
+  out=$(./stockfish bench $args 2>&1)
+
+  echo "$layout:"
+  echo "$out" | grep -E "Nodes searched|Nodes/second|TT layout|TT bad moves|TT torn entries"
+
+  echo "$out" | grep -q "TT layout       : $expected$"
+
+  if [ "$threads" = "1" ] && echo "$out" | grep -q "TT torn entries"; then
+    test $(echo "$out" | grep "TT torn entries" | awk '{print $5}') -eq 0
+  fi
+done
+
+echo "tt layout comparison OK"